@@ -17,6 +17,7 @@
 #include <math.h>
 #include <inttypes.h>
 #include <time.h>
+#include <sys/time.h>
 
 #include "mm.h"
 #include "memlib.h"
@@ -33,6 +34,11 @@
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
+/* Stress mode */
+#define STRESS_PERIOD   1000  /* default: validate one in this many ops */
+#define STRESS_CHECK    4096  /* ops between clock reads in stress mode */
+#define STRESS_REPORT    1.0  /* secs between stress mode progress lines */
+
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((uintptr_t)(p)) % ALIGNMENT) == 0)
 
@@ -129,6 +135,7 @@ static void eval_libc_speed(void *ptr);
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges, double *inst_ratio);
 static void eval_mm_speed(void *ptr);
+static int eval_mm_stress(trace_t *trace, int tracenum, double secs, int period);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
@@ -154,6 +161,8 @@ int main(int argc, char **argv)
 
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    double stress_secs = 0;          /* If set, run stress mode (set by -s) */
+    int stress_period = STRESS_PERIOD; /* stress sampling period (-p) */
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, inst_util, avg_mm_inst_util, avg_mm_util, avg_mm_throughput;
@@ -163,7 +172,7 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:s:p:hvVgal")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -183,6 +192,16 @@ int main(int argc, char **argv)
 	    if (tracedir[strlen(tracedir)-1] != '/') 
 		strcat(tracedir, "/"); /* path always ends with "/" */
 	    break;
+        case 's': /* Stress mode: run each trace repeatedly for secs */
+            stress_secs = atof(optarg);
+            if (stress_secs <= 0)
+                app_error("ERROR: -s expects a positive number of seconds");
+            break;
+        case 'p': /* Stress mode: validate one in every p ops */
+            stress_period = atoi(optarg);
+            if (stress_period <= 0)
+                app_error("ERROR: -p expects a positive sampling period");
+            break;
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
@@ -214,6 +233,22 @@ int main(int argc, char **argv)
     /* Initialize the timing package */
     init_fsecs();
 
+    /*
+     * In stress mode, skip the normal evaluation and just hammer the
+     * mm package with each trace for the requested amount of time
+     */
+    if (stress_secs > 0) {
+	mem_init();
+	numcorrect = 0;
+	for (i=0; i < num_tracefiles; i++) {
+	    trace = read_trace(tracedir, tracefiles[i]);
+	    numcorrect += eval_mm_stress(trace, i, stress_secs, stress_period);
+	    free_trace(trace);
+	}
+	printf("Stress: %d of %d traces passed\n", numcorrect, num_tracefiles);
+	exit(errors == 0 ? 0 : 1);
+    }
+
     /*
      * Optionally run and evaluate the libc malloc package 
      */
@@ -829,6 +864,247 @@ static void eval_mm_speed(void *ptr)
     mem_reset();
 }
 
+/*
+ * The following routines implement stress mode, which runs a trace
+ * over and over for a long time. Checking every op the way
+ * eval_mm_valid does is far too slow for that, so only a random
+ * sample of ops is validated and the rest run at full speed.
+ */
+
+/*
+ * stress_now - Wall clock time in seconds
+ */
+static double stress_now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/*
+ * stress_check_block - Check a sampled block the same way add_range
+ *     does: it must be aligned, lie on mapped pages, and not overlap
+ *     any other live block. Live blocks are the non-NULL entries of
+ *     trace->blocks, so the overlap check costs one scan of the ids.
+ */
+static int stress_check_block(trace_t *trace, int tracenum, int opnum,
+			      int index, char *lo, int size)
+{
+    char *hi = lo + size - 1;
+    char *plo, *phi;
+    size_t page_size = mem_pagesize(), i;
+    int id;
+
+    if (!IS_ALIGNED(lo)) {
+	sprintf(msg, "Payload address (%p) not aligned to %d bytes", 
+		lo, ALIGNMENT);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
+    }
+
+    for (i = 0; i < size; i += page_size) {
+	if (!pagemap_is_mapped(lo+i)) {
+	    sprintf(msg, "Payload (%p:%p) includes an unmapped page", lo, hi);
+	    malloc_error(tracenum, opnum, msg);
+	    return 0;
+	}
+    }
+    if (!pagemap_is_mapped(hi)) {
+	sprintf(msg, "Payload (%p:%p) ends at an unmapped page", lo, hi);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
+    }
+
+    for (id = 0; id < trace->num_ids; id++) {
+	if (id == index || trace->blocks[id] == NULL)
+	    continue;
+	plo = trace->blocks[id];
+	phi = plo + trace->block_sizes[id] - 1;
+	if (lo <= phi && hi >= plo) {
+	    sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)",
+		    lo, hi, plo, phi);
+	    malloc_error(tracenum, opnum, msg);
+	    return 0;
+	}
+    }
+
+    return 1;
+}
+
+/*
+ * stress_check_pattern - Make sure a sampled block still holds the
+ *     byte pattern we filled it with when it was allocated
+ */
+static int stress_check_pattern(trace_t *trace, int tracenum, int opnum,
+				int index)
+{
+    unsigned char *p = (unsigned char *)trace->blocks[index];
+    size_t i;
+
+    for (i = 0; i < trace->block_sizes[index]; i++) {
+	if (p[i] != (index & 0xFF)) {
+	    sprintf(msg, "Payload of block %d (%p) was overwritten at offset %lu",
+		    index, p, (unsigned long)i);
+	    malloc_error(tracenum, opnum, msg);
+	    return 0;
+	}
+    }
+
+    return 1;
+}
+
+/*
+ * eval_mm_stress - Run the trace repeatedly against the mm package for
+ *     secs seconds without resetting the heap between passes. After
+ *     each pass every block that is still live is freed, so the heap
+ *     size at the end of a pass should not creep up over time. One in
+ *     period ops (chosen at random) is validated; sampled blocks also
+ *     get their payload filled and checked again when they are freed.
+ *     Prints ops/sec and heap size about once a second.
+ */
+static int eval_mm_stress(trace_t *trace, int tracenum, double secs, int period)
+{
+    int i, index, size, sampled;
+    char *p, *oldp;
+    char *patterned;
+    long passes = 0, ops = 0, last_ops = 0;
+    double start, now, last;
+    size_t heap, peak_heap = 0, live = 0;
+    size_t first_heap = 0, last_heap = 0;
+
+    if ((patterned = (char *)calloc(trace->num_ids, 1)) == NULL)
+	unix_error("calloc failed in eval_mm_stress");
+
+    if (mm_init() < 0) {
+	malloc_error(tracenum, 0, "mm_init failed.");
+	free(patterned);
+	return 0;
+    }
+
+    printf("Stress testing trace %d for %.0f secs, validating 1 in %d ops\n",
+	   tracenum, secs, period);
+    printf("%8s%8s%12s%10s%10s%10s%10s\n",
+	   "secs", "passes", "ops", "Kops/s", "heapKB", "peakKB", "liveKB");
+
+    start = last = stress_now();
+    do {
+	memset(trace->blocks, 0, trace->num_ids * sizeof(char *));
+	live = 0;
+
+	for (i = 0;  i < trace->num_ops;  i++) {
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    sampled = (rand() % period) == 0;
+
+	    switch (trace->ops[i].type) {
+
+	    case ALLOC: /* mm_malloc */
+		if ((p = mm_malloc(size)) == NULL) {
+		    malloc_error(tracenum, i, "mm_malloc failed.");
+		    goto fail;
+		}
+		if (sampled && !stress_check_block(trace, tracenum, i,
+						   index, p, size))
+		    goto fail;
+		trace->blocks[index] = p;
+		trace->block_sizes[index] = size;
+		live += size;
+		break;
+
+	    case REALLOC: /* mm_malloc + mm_free */
+		oldp = trace->blocks[index];
+		if ((p = mm_malloc(size)) == NULL) {
+		    malloc_error(tracenum, i, "mm_malloc failed.");
+		    goto fail;
+		}
+		if (patterned[index] && !stress_check_pattern(trace, tracenum,
+							       i, index))
+		    goto fail;
+		if (sampled && !stress_check_block(trace, tracenum, i,
+						   index, p, size))
+		    goto fail;
+		mm_free(oldp);
+		live += size - trace->block_sizes[index];
+		trace->blocks[index] = p;
+		trace->block_sizes[index] = size;
+		break;
+
+	    case FREE: /* mm_free */
+		if (patterned[index] && !stress_check_pattern(trace, tracenum,
+							       i, index))
+		    goto fail;
+		mm_free(trace->blocks[index]);
+		live -= trace->block_sizes[index];
+		trace->blocks[index] = NULL;
+		patterned[index] = 0;
+		break;
+
+	    default:
+		app_error("Nonexistent request type in eval_mm_stress");
+	    }
+
+	    /* Fill sampled blocks so later overwrites can be caught */
+	    if (trace->ops[i].type != FREE) {
+		patterned[index] = sampled;
+		if (sampled)
+		    memset(trace->blocks[index], index & 0xFF, size);
+	    }
+
+	    heap = mem_heapsize();
+	    if (heap > peak_heap)
+		peak_heap = heap;
+
+	    ops++;
+	    if ((ops % STRESS_CHECK) == 0
+		&& (now = stress_now()) - last >= STRESS_REPORT) {
+		printf("%8.0f%8ld%12ld%10.0f%10lu%10lu%10lu\n",
+		       now - start, passes, ops,
+		       ((ops - last_ops) / 1e3) / (now - last),
+		       (unsigned long)(heap >> 10),
+		       (unsigned long)(peak_heap >> 10),
+		       (unsigned long)(live >> 10));
+		fflush(stdout);
+		last = now;
+		last_ops = ops;
+	    }
+	}
+
+	/* Release whatever the trace left allocated */
+	for (index = 0; index < trace->num_ids; index++) {
+	    if (trace->blocks[index] == NULL)
+		continue;
+	    if (patterned[index] && !stress_check_pattern(trace, tracenum,
+							   trace->num_ops - 1,
+							   index))
+		goto fail;
+	    mm_free(trace->blocks[index]);
+	    patterned[index] = 0;
+	}
+
+	last_heap = mem_heapsize();
+	if (passes++ == 0)
+	    first_heap = last_heap;
+    } while (stress_now() - start < secs);
+
+    now = stress_now();
+    printf("Trace %d: %ld passes, %ld ops in %.1f secs (%.0f Kops/s)\n",
+	   tracenum, passes, ops, now - start, (ops / 1e3) / (now - start));
+    printf("Trace %d: heap after first pass %lu KB, after last pass %lu KB, "
+	   "peak %lu KB\n\n", tracenum,
+	   (unsigned long)(first_heap >> 10), (unsigned long)(last_heap >> 10),
+	   (unsigned long)(peak_heap >> 10));
+
+    free(patterned);
+    mem_reset();
+    return 1;
+
+ fail:
+    free(patterned);
+    mem_reset();
+    return 0;
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -1014,12 +1290,14 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>] [-s <secs> [-p <n>]]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-p <n>     In stress mode, validate one in <n> ops (default %d).\n", STRESS_PERIOD);
+    fprintf(stderr, "\t-s <secs>  Stress mode: rerun each trace for <secs> seconds.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
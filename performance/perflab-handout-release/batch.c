@@ -0,0 +1,150 @@
+/* Double buffered batch pipeline, see batch.h */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "defs.h"
+#include "batch.h"
+#include "image.h"
+#include "hugepage.h"
+
+/* One group of frames, as seen by the I/O thread */
+typedef struct {
+  int dim;
+  batch_io_func load, store;
+  void *arg;
+  pixel **in, **out;      /* group to load and group to store */
+  int load0, nload;       /* frames [load0, load0 + nload) */
+  int store0, nstore;     /* frames [store0, store0 + nstore) */
+  int status;
+} io_job;
+
+static void *io_thread(void *vargp)
+{
+  io_job *j = (io_job *)vargp;
+  int k;
+
+  for (k = 0; k < j->nstore; k++)
+    if (j->store(j->arg, j->store0 + k, j->dim, j->out[k]) < 0)
+      j->status = -1;
+  for (k = 0; k < j->nload; k++)
+    if (j->load(j->arg, j->load0 + k, j->dim, j->in[k]) < 0)
+      j->status = -1;
+  return NULL;
+}
+
+static void *alloc_or_die(size_t size)
+{
+  void *p = malloc(size);
+
+  if (p == NULL) {
+    fprintf(stderr, "Fatal error.  malloc failed in batch_pipeline\n");
+    exit(1);
+  }
+  return p;
+}
+
+int batch_pipeline(batch_func f, int dim, int nframes, int group,
+                   batch_io_func load, batch_io_func store, void *arg)
+{
+  pixel **bufs[2][2];  /* [buffer][in, out][frame of group] */
+  io_job job = { dim, load, store, arg };
+  pthread_t tid;
+  int b, k, g, n, next, status = 0;
+  size_t frame, size;
+  char *frames;
+
+  if (nframes <= 0)
+    return 0;
+  if (group < 1)
+    group = 1;
+
+  // All 4 * group frames in one huge page buffer, each 64 byte aligned
+  frame = ((size_t)dim * dim * sizeof(pixel) + 63) & ~(size_t)63;
+  size = 4 * group * frame;
+  frames = huge_alloc(size);
+  for (b = 0; b < 2; b++) {
+    bufs[b][0] = alloc_or_die(group * sizeof(pixel *));
+    bufs[b][1] = alloc_or_die(group * sizeof(pixel *));
+    for (k = 0; k < group; k++) {
+      bufs[b][0][k] = (pixel *)(frames + ((4 * k + 2 * b) * frame));
+      bufs[b][1][k] = (pixel *)(frames + ((4 * k + 2 * b + 1) * frame));
+    }
+  }
+
+  n = (group < nframes) ? group : nframes;
+  for (k = 0; k < n; k++)
+    if (load(arg, k, dim, bufs[0][0][k]) < 0)
+      status = -1;
+
+  // Group g is in buffer g % 2; group g - 1 is stored and group g + 1
+  // loaded through the other buffer while f works on group g
+  for (g = 0, b = 0; g * group < nframes; g++, b ^= 1) {
+    n = (nframes - g * group < group) ? nframes - g * group : group;
+    next = (g + 1) * group;
+
+    job.in = bufs[b ^ 1][0];
+    job.load0 = next;
+    job.nload = (next >= nframes) ? 0
+      : (nframes - next < group) ? nframes - next : group;
+    job.out = bufs[b ^ 1][1];
+    job.store0 = (g - 1) * group;
+    job.nstore = (g == 0) ? 0 : group;
+    job.status = 0;
+    if (pthread_create(&tid, NULL, io_thread, &job) != 0) {
+      fprintf(stderr, "Fatal error.  pthread_create failed in batch_pipeline\n");
+      exit(1);
+    }
+
+    f(dim, bufs[b][0], bufs[b][1], n);
+
+    pthread_join(tid, NULL);
+    if (job.status < 0)
+      status = -1;
+  }
+
+  // The last group was computed but not stored yet
+  g--;
+  b ^= 1;
+  n = nframes - g * group;
+  for (k = 0; k < n; k++)
+    if (store(arg, g * group + k, dim, bufs[b][1][k]) < 0)
+      status = -1;
+
+  for (b = 0; b < 2; b++) {
+    free(bufs[b][0]);
+    free(bufs[b][1]);
+  }
+  huge_free(frames, size);
+  return status;
+}
+
+int batch_load_file(void *arg, int frame, int dim, pixel *img)
+{
+  batch_files *files = (batch_files *)arg;
+  image_file *f = image_open(files->in[frame], 0);
+  image_band band;
+  pixel *p;
+
+  if (f == NULL)
+    return -1;
+  if (f->rows != dim || f->cols != dim || f->layout != IMAGE_INTERLEAVED) {
+    fprintf(stderr, "%s is not a %d x %d interleaved image\n",
+            files->in[frame], dim, dim);
+    image_close(f);
+    return -1;
+  }
+  p = image_map(f, 0, dim, &band);
+  memcpy(img, p, (size_t)dim * dim * sizeof(pixel));
+  image_unmap(&band);
+  image_close(f);
+  return 0;
+}
+
+int batch_store_file(void *arg, int frame, int dim, pixel *img)
+{
+  batch_files *files = (batch_files *)arg;
+
+  return image_write(files->out[frame], dim, dim, img, IMAGE_INTERLEAVED);
+}
@@ -0,0 +1,47 @@
+/*
+ * batch.h - Multi-frame batches of complex and motion for the
+ * Performance Lab.
+ *
+ * A batch is an array of nframes dim x dim frames, as in a video.
+ * complex_batch and motion_batch run whole frames as pool tasks (see
+ * pool.h), each frame on one thread, so the threads never share a
+ * frame and never wait for each other inside one. batch_pipeline
+ * runs a batch kernel over frames that are loaded and stored by
+ * callbacks, for example from image files (see image.h), with the
+ * I/O of one group of frames overlapped with the compute of the next.
+ */
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include "defs.h"
+
+typedef void (*batch_func)(int dim, pixel **src, pixel **dst, int nframes);
+
+/* dst[f] = complex(src[f]) and dst[f] = motion(src[f]) for every frame f */
+void complex_batch(int dim, pixel **src, pixel **dst, int nframes);
+void motion_batch(int dim, pixel **src, pixel **dst, int nframes);
+
+/* Loads frame f into img, or stores img as frame f. Return 0 on
+   success, -1 on error. */
+typedef int (*batch_io_func)(void *arg, int frame, int dim, pixel *img);
+
+/*
+ * batch_pipeline - Run f over nframes frames, group frames at a time,
+ * double buffered: while f works on one group, a separate I/O thread
+ * stores the results of the group before it and loads the group after
+ * it. Returns 0 on success, -1 if a load or store failed.
+ */
+int batch_pipeline(batch_func f, int dim, int nframes, int group,
+                   batch_io_func load, batch_io_func store, void *arg);
+
+/* Frames kept in interleaved image files, one file per frame */
+typedef struct {
+  char **in;   /* in[f] is loaded as frame f */
+  char **out;  /* result f is stored to out[f] */
+} batch_files;
+
+/* batch_io_funcs for a batch_files arg */
+int batch_load_file(void *arg, int frame, int dim, pixel *img);
+int batch_store_file(void *arg, int frame, int dim, pixel *img);
+
+#endif /* _BATCH_H_ */
@@ -0,0 +1,127 @@
+/*
+ * conv.h - Compile time specialized convolution engine for the
+ * Performance Lab.
+ *
+ * Output pixel (i,j) is the weighted average of the k x k window of
+ * src whose top left corner is (i,j). Near the bottom and right edges
+ * the window is cut off by the image, and the average is taken over
+ * the weights that are still inside. motion is the 3x3 box filter.
+ *
+ * Everything here is always inlined. When k and the weights are
+ * compile time constants at the call site (a static const array),
+ * the compiler unrolls every window, folds the weights and their sums,
+ * and turns the divides into multiplies, separately for the interior
+ * and for each of the (k-1)^2 + 2(k-1) cut off window shapes.
+ *
+ * Other filters built on the engine are registered with
+ * add_conv_function, with their size and weights, and "driver -G"
+ * checks and times them.
+ */
+#ifndef _CONV_H_
+#define _CONV_H_
+
+#include "defs.h"
+
+void register_conv_functions(void);
+void add_conv_function(motion_test_func, char*, int k, const int *w);
+
+#define CONV_INLINE static inline __attribute__((always_inline))
+
+/*
+ * conv_window - Output pixel (i,j) of an image ncols wide, from the
+ * top left rows x cols part of the k x k filter w
+ */
+CONV_INLINE pixel conv_window(int ncols, int i, int j, pixel *src,
+                              const int rows, const int cols,
+                              const int k, const int *w)
+{
+  int ii, jj, weight, total = 0;
+  int r = 0, g = 0, b = 0;
+  pixel *s, out;
+
+#pragma GCC unroll 16
+  for (ii = 0; ii < rows; ii++) {
+    s = &src[RIDX(i + ii, j, ncols)];
+#pragma GCC unroll 16
+    for (jj = 0; jj < cols; jj++) {
+      weight = w[ii * k + jj];
+      total += weight;
+      r += weight * s[jj].red;
+      g += weight * s[jj].green;
+      b += weight * s[jj].blue;
+    }
+  }
+
+  out.red = (unsigned short)(r / total);
+  out.green = (unsigned short)(g / total);
+  out.blue = (unsigned short)(b / total);
+  return out;
+}
+
+/*
+ * conv_row_range - Output columns [j0, j1) of row i, whose windows
+ * have rows rows left in the image: full k wide windows, then the last
+ * k-1 columns, each with its own constant width
+ */
+CONV_INLINE void conv_row_range(int ncols, int i, pixel *src, pixel *dst,
+                                int j0, int j1, const int rows,
+                                const int k, const int *w)
+{
+  int j, cols, jend = (j1 < ncols - k + 1) ? j1 : ncols - k + 1;
+
+  for (j = j0; j < jend; j++)
+    dst[RIDX(i, j, ncols)] = conv_window(ncols, i, j, src, rows, k, k, w);
+
+#pragma GCC unroll 16
+  for (cols = k - 1; cols >= 1; cols--) {
+    j = ncols - cols;
+    if (j >= 0 && j >= j0 && j < j1)
+      dst[RIDX(i, j, ncols)] = conv_window(ncols, i, j, src, rows, cols, k, w);
+  }
+}
+
+/* conv_row_range for the whole row */
+CONV_INLINE void conv_row(int ncols, int i, pixel *src, pixel *dst,
+                          const int rows, const int k, const int *w)
+{
+  conv_row_range(ncols, i, src, dst, 0, ncols, rows, k, w);
+}
+
+/*
+ * conv_rect - Filter the output rectangle rows [i0, i1) x columns
+ * [j0, j1) of an nrows x ncols image with the k x k filter w (k*k
+ * weights, row major, positive sum over every top left sub-window)
+ */
+CONV_INLINE void conv_rect(int nrows, int ncols, pixel *src, pixel *dst,
+                           int i0, int i1, int j0, int j1,
+                           const int k, const int *w)
+{
+  int i, rows;
+
+  for (i = i0; i < i1 && i + k <= nrows; i++)
+    conv_row_range(ncols, i, src, dst, j0, j1, k, k, w);
+
+  // Bottom rows, one constant window height each
+#pragma GCC unroll 16
+  for (rows = k - 1; rows >= 1; rows--) {
+    i = nrows - rows;
+    if (i >= i0 && i < i1)
+      conv_row_range(ncols, i, src, dst, j0, j1, rows, k, w);
+  }
+}
+
+/* conv_rect over whole rows [i0, i1) */
+CONV_INLINE void conv_rect_rows(int nrows, int ncols, pixel *src, pixel *dst,
+                                int i0, int i1, const int k, const int *w)
+{
+  conv_rect(nrows, ncols, src, dst, i0, i1, 0, ncols, k, w);
+}
+
+/* conv_rect_rows for a dim x dim image */
+CONV_INLINE void conv_rows(int dim, pixel *src, pixel *dst, int i0, int i1,
+                           const int k, const int *w)
+{
+  conv_rect_rows(dim, dim, src, dst, i0, i1, k, w);
+}
+
+#endif /* _CONV_H_ */
@@ -0,0 +1,115 @@
+/*
+ * convert-image.c - Convert between the text ".image" files written by
+ * older versions of the driver and binary image files (see image.h).
+ *
+ * A text file starts with the width and height, then has the red,
+ * green and blue of every pixel as decimal numbers, row by row.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "defs.h"
+#include "image.h"
+
+static void usage(char *progname)
+{
+  fprintf(stderr, "Usage: %s [-p] <in> <out>\n", progname);
+  fprintf(stderr, "  A text <in> is written to <out> as a binary image file,\n");
+  fprintf(stderr, "  interleaved, or planar with -p. A binary <in> of either\n");
+  fprintf(stderr, "  layout is written to <out> as text.\n");
+  exit(EXIT_FAILURE);
+}
+
+/* Read a text image into a new pixel array */
+static pixel *read_text(char *path, int *rows, int *cols)
+{
+  FILE *f;
+  pixel *img;
+  unsigned int r, g, b;
+  long i, n;
+
+  if ((f = fopen(path, "r")) == NULL)
+    return NULL;
+  if (fscanf(f, "%d %d", cols, rows) != 2 || *rows < 0 || *cols < 0) {
+    fclose(f);
+    return NULL;
+  }
+
+  n = (long)*rows * *cols;
+  if ((img = malloc(n > 0 ? n * sizeof(pixel) : 1)) == NULL) {
+    fprintf(stderr, "Fatal error.  malloc failed in read_text\n");
+    exit(1);
+  }
+  for (i = 0; i < n; i++) {
+    if (fscanf(f, "%u %u %u", &r, &g, &b) != 3) {
+      fprintf(stderr, "%s: expected %ld pixels, found %ld\n", path, n, i);
+      exit(1);
+    }
+    img[i].red = r;
+    img[i].green = g;
+    img[i].blue = b;
+  }
+
+  fclose(f);
+  return img;
+}
+
+/* Write a pixel array as a text image */
+static int write_text(char *path, int rows, int cols, pixel *img)
+{
+  FILE *f;
+  int i, j;
+
+  if ((f = fopen(path, "w")) == NULL)
+    return -1;
+
+  fprintf(f, "%d %d\n", cols, rows);
+  for (i = 0; i < rows; i++) {
+    for (j = 0; j < cols; j++) {
+      if (j > 0)
+        fprintf(f, " ");
+      fprintf(f, "%d %d %d", img[RIDX(i,j,cols)].red,
+              img[RIDX(i,j,cols)].green, img[RIDX(i,j,cols)].blue);
+    }
+    fprintf(f, "\n");
+  }
+
+  return fclose(f) == 0 ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+  int c, rows, cols, err;
+  int layout = IMAGE_INTERLEAVED;
+  pixel *img;
+
+  while ((c = getopt(argc, argv, "ph")) != -1)
+    switch (c) {
+    case 'p':
+      layout = IMAGE_PLANAR;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  if (argc - optind != 2)
+    usage(argv[0]);
+
+  // Binary in gives text out, anything else is read as text
+  if ((img = image_read(argv[optind], &rows, &cols)) != NULL)
+    err = write_text(argv[optind + 1], rows, cols, img);
+  else if ((img = read_text(argv[optind], &rows, &cols)) != NULL)
+    err = image_write(argv[optind + 1], rows, cols, img, layout);
+  else {
+    fprintf(stderr, "Can't read image %s\n", argv[optind]);
+    exit(1);
+  }
+
+  if (err < 0) {
+    fprintf(stderr, "Can't write image %s\n", argv[optind + 1]);
+    exit(1);
+  }
+  free(img);
+  return 0;
+}
@@ -0,0 +1,139 @@
+/*
+ * depth.h - complex and motion at either channel depth for the
+ * Performance Lab.
+ *
+ * A pixel has three 16 bit channels; a pixel8 has three 8 bit ones,
+ * half the bytes, for sources that are 8 bit to begin with. Both are
+ * arrays of channels, three per pixel in red, green, blue order, so
+ * the kernels here are written once over a channel array and a
+ * compile time depth (1 or 2 bytes per channel) and always inlined
+ * into a version for each type. The averages are the same integer
+ * averages at both depths, so a pixel8 image gives the same output as
+ * the pixel image with the same channel values.
+ */
+#ifndef _DEPTH_H_
+#define _DEPTH_H_
+
+#include "defs.h"
+
+typedef struct {
+   unsigned char red;
+   unsigned char green;
+   unsigned char blue;
+} pixel8;
+
+typedef void (*pixel8_test_func) (int, pixel8*, pixel8*);
+
+void register_pixel8_functions(void);
+void add_pixel8_complex_function(pixel8_test_func, char*);
+void add_pixel8_motion_function(pixel8_test_func, char*);
+
+/* The 16 bit builds, ordinary versions of complex and motion */
+extern char depth_complex_descr[], depth_motion_descr[];
+void depth_complex(int dim, pixel *src, pixel *dest);
+void depth_motion(int dim, pixel *src, pixel *dst);
+
+#define DEPTH_INLINE static inline __attribute__((always_inline))
+
+/* Channel k of an image at the given depth */
+DEPTH_INLINE int depth_get(const void *img, long k, const int depth)
+{
+  if (depth == 1)
+    return ((const unsigned char *)img)[k];
+  return ((const unsigned short *)img)[k];
+}
+
+DEPTH_INLINE void depth_set(void *img, long k, int v, const int depth)
+{
+  if (depth == 1)
+    ((unsigned char *)img)[k] = v;
+  else
+    ((unsigned short *)img)[k] = v;
+}
+
+/*
+ * depth_complex_block - complex for src rows [i0, i1) and columns
+ * [j0, j1). Going down a src column walks along a dest row.
+ */
+DEPTH_INLINE void depth_complex_block(int dim, const void *src, void *dest,
+                                      int i0, int i1, int j0, int j1,
+                                      const int depth)
+{
+  int i, j, gray;
+  long s, d;
+
+  for (j = j0; j < j1; j++)
+    for (i = i0; i < i1; i++) {
+      s = 3L * RIDX(i, j, dim);
+      d = 3L * RIDX(dim - 1 - j, dim - 1 - i, dim);
+      gray = (depth_get(src, s, depth) + depth_get(src, s + 1, depth) +
+              depth_get(src, s + 2, depth)) / 3;
+      depth_set(dest, d, gray, depth);
+      depth_set(dest, d + 1, gray, depth);
+      depth_set(dest, d + 2, gray, depth);
+    }
+}
+
+/*
+ * depth_motion_row - One output row from the channel sums of its
+ * (up to 3) window rows, rows of them. sums has 3 entries per column,
+ * so the 3 wide window over channel k is sums[k], sums[k+3], sums[k+6]
+ * and a whole row is one flat loop.
+ */
+DEPTH_INLINE void depth_motion_row(int dim, const int *sums, void *out,
+                                   const int rows, const int depth)
+{
+  long k, full = 3L * (dim - 2);
+
+  for (k = 0; k < full; k++)
+    depth_set(out, k, (sums[k] + sums[k + 3] + sums[k + 6]) / (3 * rows), depth);
+
+  // Last two columns, where the window shrinks
+  for (k = (full > 0) ? full : 0; k < 3L * (dim - 1); k++)
+    depth_set(out, k, (sums[k] + sums[k + 3]) / (2 * rows), depth);
+  for (k = 3L * (dim - 1); k < 3L * dim; k++)
+    depth_set(out, k, sums[k] / rows, depth);
+}
+
+/*
+ * depth_motion_rows - motion for the output rows [i0, i1) with rolling
+ * column sums in sums (3*dim ints), which start from the (up to) 3
+ * rows below i0
+ */
+DEPTH_INLINE void depth_motion_rows(int dim, const void *src, void *dst,
+                                    int i0, int i1, int *sums,
+                                    const int depth)
+{
+  int i;
+  long k, n = 3L * dim;
+
+  for (k = 0; k < n; k++)
+    sums[k] = 0;
+  for (i = i0; i < i0 + 3 && i < dim; i++)
+    for (k = 0; k < n; k++)
+      sums[k] += depth_get(src, i * n + k, depth);
+
+  for (i = i0; i < i1; i++) {
+    // Separate calls so each one divides by a constant
+    if (i < dim - 2)
+      depth_motion_row(dim, sums, (char *)dst + i * n * depth, 3, depth);
+    else if (i == dim - 2)
+      depth_motion_row(dim, sums, (char *)dst + i * n * depth, 2, depth);
+    else
+      depth_motion_row(dim, sums, (char *)dst + i * n * depth, 1, depth);
+
+    if (i + 1 == i1)
+      break;
+
+    // Move the window down: drop row i, add row i + 3 if there is one
+    if (i + 3 < dim)
+      for (k = 0; k < n; k++)
+        sums[k] += depth_get(src, (i + 3) * n + k, depth) -
+          depth_get(src, i * n + k, depth);
+    else
+      for (k = 0; k < n; k++)
+        sums[k] -= depth_get(src, i * n + k, depth);
+  }
+}
+
+#endif /* _DEPTH_H_ */
@@ -0,0 +1,91 @@
+/* Dirty tile maps, see dirty.h */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defs.h"
+#include "dirty.h"
+#include "pool.h"
+
+dirty_map *dirty_alloc(int dim)
+{
+  dirty_map *m = malloc(sizeof(dirty_map));
+
+  if (m == NULL) {
+    fprintf(stderr, "Fatal error.  malloc failed in dirty_alloc\n");
+    exit(1);
+  }
+  m->dim = dim;
+  m->tiles = (dim + DIRTY_TILE - 1) / DIRTY_TILE;
+  m->map = calloc((size_t)m->tiles * m->tiles, 1);
+  if (m->map == NULL) {
+    fprintf(stderr, "Fatal error.  calloc failed in dirty_alloc\n");
+    exit(1);
+  }
+  return m;
+}
+
+void dirty_free(dirty_map *m)
+{
+  free(m->map);
+  free(m);
+}
+
+void dirty_clear(dirty_map *m)
+{
+  memset(m->map, 0, (size_t)m->tiles * m->tiles);
+}
+
+void dirty_all(dirty_map *m)
+{
+  memset(m->map, 1, (size_t)m->tiles * m->tiles);
+}
+
+void dirty_mark(dirty_map *m, int i, int j)
+{
+  m->map[(i / DIRTY_TILE) * m->tiles + j / DIRTY_TILE] = 1;
+}
+
+typedef struct {
+  pixel *prev, *cur;
+  dirty_map *m;
+} diff_args;
+
+/* One row of tiles. Whole rows are compared first, since in a mostly
+   static frame most of them are equal. */
+static void diff_task(void *vargs, int ti)
+{
+  diff_args *a = (diff_args *)vargs;
+  int dim = a->m->dim, tiles = a->m->tiles;
+  int i, tj, j0, n;
+  int i1 = (ti + 1) * DIRTY_TILE < dim ? (ti + 1) * DIRTY_TILE : dim;
+  unsigned char *row = &a->m->map[ti * tiles];
+  pixel *p, *c;
+
+  memset(row, 0, tiles);
+  for (i = ti * DIRTY_TILE; i < i1; i++) {
+    p = &a->prev[RIDX(i, 0, dim)];
+    c = &a->cur[RIDX(i, 0, dim)];
+    if (memcmp(p, c, dim * sizeof(pixel)) == 0)
+      continue;
+    for (tj = 0; tj < tiles; tj++) {
+      if (row[tj])
+        continue;
+      j0 = tj * DIRTY_TILE;
+      n = (j0 + DIRTY_TILE < dim) ? DIRTY_TILE : dim - j0;
+      if (memcmp(p + j0, c + j0, n * sizeof(pixel)) != 0)
+        row[tj] = 1;
+    }
+  }
+}
+
+int dirty_diff(pixel *prev, pixel *cur, dirty_map *m)
+{
+  diff_args args = { prev, cur, m };
+  int t, n = 0;
+
+  pool_run(diff_task, &args, m->tiles);
+  for (t = 0; t < m->tiles * m->tiles; t++)
+    n += m->map[t];
+  return n;
+}
@@ -0,0 +1,46 @@
+/*
+ * dirty.h - Incremental motion across video frames for the
+ * Performance Lab.
+ *
+ * A dirty map splits a dim x dim frame into DIRTY_TILE x DIRTY_TILE
+ * tiles and records which of them changed since the previous frame.
+ * dirty_diff fills one in by comparing two frames; motion_incremental
+ * then brings the previous motion output up to date by recomputing
+ * only the output tiles whose 3x3 windows reach a changed tile.
+ */
+#ifndef _DIRTY_H_
+#define _DIRTY_H_
+
+#include "defs.h"
+
+#define DIRTY_TILE 32
+
+typedef struct {
+  int dim;              /* frame is dim x dim */
+  int tiles;            /* tiles per side */
+  unsigned char *map;   /* map[ti * tiles + tj] != 0 if tile changed */
+} dirty_map;
+
+dirty_map *dirty_alloc(int dim);
+void dirty_free(dirty_map *m);
+
+/* Mark no tiles, or every tile, as changed */
+void dirty_clear(dirty_map *m);
+void dirty_all(dirty_map *m);
+
+/* Mark the tile holding pixel (i,j) as changed */
+void dirty_mark(dirty_map *m, int i, int j);
+
+/* Set m to the tiles in which prev and cur differ, return how many */
+int dirty_diff(pixel *prev, pixel *cur, dirty_map *m);
+
+/*
+ * motion_incremental - dst holds motion() of the previous frame; make
+ * it motion(src), where src differs from the previous frame only in
+ * the tiles marked in m. Output pixel (i,j) reads src rows i..i+2 and
+ * columns j..j+2, so an output tile is redone if its own src tile or
+ * the one below, to the right or diagonally below right is marked.
+ */
+void motion_incremental(int dim, pixel *src, pixel *dst, dirty_map *m);
+
+#endif /* _DIRTY_H_ */
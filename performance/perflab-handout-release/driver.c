@@ -23,9 +23,28 @@
 #include <time.h>
 #include <assert.h>
 #include <math.h>
+#include <sys/resource.h>
 #include "fcyc.h"
 #include "defs.h"
 #include "config.h"
+#include "pool.h"
+#include "planar.h"
+#include "tune.h"
+#include "orient.h"
+#include "fused.h"
+#include "image.h"
+#include "stream.h"
+#include "clock.h"
+#include "isa.h"
+#include "batch.h"
+#include "dirty.h"
+#include "depth.h"
+#include "sat.h"
+#include "hugepage.h"
+#include "stats.h"
+#include "hash.h"
+#include "inplace.h"
+#include "conv.h"
 
 /* Student structure that identifies the students */
 extern student_t student; 
@@ -38,6 +57,7 @@ extern student_t student;
 #define BSIZE 64     /* cache block size in bytes */     
 #define MAX_DIM 1280 /* 1024 + 256 */
 #define ODD_DIM 96   /* not a power of 2 */
+#define RAGGED_DIM 101 /* not a multiple of the 8x8 blocks */
 
 /* fast versions of min and max */
 #define min(a,b) (a < b ? a : b)
@@ -48,6 +68,8 @@ typedef struct {
   union {
     complex_test_func complex_funct; /* The test function */
     motion_test_func motion_funct; /* The test function */
+    planar_test_func planar_funct; /* The test function */
+    pixel8_test_func pixel8_funct; /* The test function */
   };
     double cpes[DIM_CNT]; /* One CPE result for each dimension */
     char *description;    /* ASCII description of the test function */
@@ -66,26 +88,51 @@ static double motion_baseline_cpes[] = {S32, S64, S128, S256, S512};
 /* These hold the results for all benchmarks */
 static bench_t benchmarks_complex[MAX_BENCHMARKS];
 static bench_t benchmarks_motion[MAX_BENCHMARKS];
+static bench_t benchmarks_planar_complex[MAX_BENCHMARKS];
+static bench_t benchmarks_planar_motion[MAX_BENCHMARKS];
+static bench_t benchmarks_fused[MAX_BENCHMARKS];
+static bench_t benchmarks_pixel8_complex[MAX_BENCHMARKS];
+static bench_t benchmarks_pixel8_motion[MAX_BENCHMARKS];
 
 /* These give the sizes of the above lists */
 static int complex_benchmark_count = 0;
 static int motion_benchmark_count = 0;
+static int planar_complex_benchmark_count = 0;
+static int planar_motion_benchmark_count = 0;
+static int fused_benchmark_count = 0;
+static int pixel8_complex_benchmark_count = 0;
+static int pixel8_motion_benchmark_count = 0;
+
+/* Filters built on the convolution engine, with their weights (-G) */
+typedef struct {
+    motion_test_func funct;
+    char *description;
+    int k;            /* window edge */
+    const int *w;     /* k*k weights, row major */
+    double cpes[DIM_CNT];
+} filter_t;
+
+static filter_t filters[MAX_BENCHMARKS];
+static int filter_count = 0;
 
 /* 
  * An image is a dimxdim matrix of pixels stored in a 1D array.  The
  * data array holds five images (the input original, complex destination, 
  * complex temporary space, a copy of the original, 
  * and the output result array). 
- * There is also an additional BSIZE bytes
- * of padding for alignment to cache block boundaries.
+ * It is allocated with huge_alloc on its first use, so it starts on a
+ * 2 MB boundary and, unless huge pages are off, is backed by 2 MB
+ * pages (see hugepage.h).
  */
-static pixel data[(5*MAX_DIM*MAX_DIM) + (BSIZE/sizeof(pixel))];
+#define DATA_SIZE (5 * MAX_DIM * MAX_DIM * sizeof(pixel))
+static pixel *data = NULL;
 
 /* Various image pointers */
 static pixel *orig = NULL;         /* original image */
 static pixel *tmp = NULL;          /* temporary area for checking complex */
 static pixel *copy_of_orig = NULL; /* copy of original for checking result */
 static pixel *result = NULL;       /* result image */
+static pixel *stage = NULL;        /* complex output when checking fused kernels */
 
 /* Keep track of the best complex and motion score for grading */
 double complex_maxmean = 0.0;
@@ -97,6 +144,15 @@ char *motion_maxmean_desc = NULL;
 int save_test_image_files;
 int save_all_image_files;
 
+/* Read hardware counters around each measurement (see perfctr.h) */
+static int counters = 0;
+
+/* Seed for the random images (-s) */
+static int seed = 1729;
+
+/* Check results against cached golden hashes (-V) */
+static int golden_checks = 0;
+
 
 /******************** Functions begin *************************/
 
@@ -117,6 +173,55 @@ void add_complex_function(complex_test_func f, char *description)
     complex_benchmark_count++;
 }
 
+void add_planar_complex_function(planar_test_func f, char *description) 
+{
+    benchmarks_planar_complex[planar_complex_benchmark_count].planar_funct = f;
+    benchmarks_planar_complex[planar_complex_benchmark_count].description = description;
+    benchmarks_planar_complex[planar_complex_benchmark_count].valid = 0;
+    planar_complex_benchmark_count++;
+}
+
+void add_planar_motion_function(planar_test_func f, char *description) 
+{
+    benchmarks_planar_motion[planar_motion_benchmark_count].planar_funct = f;
+    benchmarks_planar_motion[planar_motion_benchmark_count].description = description;
+    benchmarks_planar_motion[planar_motion_benchmark_count].valid = 0;
+    planar_motion_benchmark_count++;
+}
+
+void add_pixel8_complex_function(pixel8_test_func f, char *description) 
+{
+    benchmarks_pixel8_complex[pixel8_complex_benchmark_count].pixel8_funct = f;
+    benchmarks_pixel8_complex[pixel8_complex_benchmark_count].description = description;
+    benchmarks_pixel8_complex[pixel8_complex_benchmark_count].valid = 0;
+    pixel8_complex_benchmark_count++;
+}
+
+void add_pixel8_motion_function(pixel8_test_func f, char *description) 
+{
+    benchmarks_pixel8_motion[pixel8_motion_benchmark_count].pixel8_funct = f;
+    benchmarks_pixel8_motion[pixel8_motion_benchmark_count].description = description;
+    benchmarks_pixel8_motion[pixel8_motion_benchmark_count].valid = 0;
+    pixel8_motion_benchmark_count++;
+}
+
+void add_fused_function(complex_test_func f, char *description) 
+{
+    benchmarks_fused[fused_benchmark_count].complex_funct = f;
+    benchmarks_fused[fused_benchmark_count].description = description;
+    benchmarks_fused[fused_benchmark_count].valid = 0;
+    fused_benchmark_count++;
+}
+
+void add_conv_function(motion_test_func f, char *description, int k, const int *w) 
+{
+    filters[filter_count].funct = f;
+    filters[filter_count].description = description;
+    filters[filter_count].k = k;
+    filters[filter_count].w = w;
+    filter_count++;
+}
+
 /* 
  * random_in_interval - Returns random integer in interval [low, high) 
  */
@@ -133,27 +238,10 @@ static int scale(int i, int from, int to) {
 static void write_image(int dim, char *variant, char *mode, pixel *img)
 {
   char buf[64];
-  int i, j;
-  FILE *f;
-
-  sprintf(buf, "%s_%s_%d.image", variant, mode, dim);
-  f = fopen(buf, "w");
-
-  fprintf(f, "%d %d\n", dim, dim);
-
-  for (i = 0; i < dim; i++) {
-    for (j = 0; j < dim; j++) {
-      if (j > 0)
-        fprintf(f, " ");
-      fprintf(f, "%d %d %d",
-              img[RIDX(i,j,dim)].red,
-              img[RIDX(i,j,dim)].green,
-              img[RIDX(i,j,dim)].blue);
-    }
-    fprintf(f, "\n");
-  }
 
-  fclose(f);
+  sprintf(buf, "%s_%s_%d.img", variant, mode, dim);
+  if (image_write(buf, dim, dim, img, IMAGE_INTERLEAVED) < 0)
+    fprintf(stderr, "Can't write image file %s\n", buf);
 }
 
 #define RANDOM   0
@@ -217,13 +305,18 @@ static void create(int dim)
 {
   int i, j;
   
-  /* Align the images to BSIZE byte boundaries */
+  /* With golden checks, the same dim, mode and seed give the same image */
+  if (golden_checks)
+    srand(seed + dim);
+
+  /* huge_alloc'd data is aligned to a 2 MB, hence BSIZE, boundary */
+  if (data == NULL)
+    data = (pixel *) huge_alloc(DATA_SIZE);
   orig = data;
-  while ((long)orig % BSIZE)
-    orig = (pixel *)(((char *)orig) + 1);
   tmp = orig + dim*dim;
   result = tmp + dim*dim;
   copy_of_orig = result + dim*dim;
+  stage = copy_of_orig + dim*dim;
   
   for (i = 0; i < dim; i++) {
     for (j = 0; j < dim; j++) {
@@ -291,20 +384,41 @@ static int check_orig(int dim)
     return 0;
 }
 
-/* 
- * check_complex - Make sure the complex actually works. 
+/*
+ * report_complex, report_motion - Print the error count and the last
+ *     wrong pixel found by a complex or motion check
  */
-static int check_complex(int dim, int save_images)
+static void report_complex(int dim, int err, int badi, int badj,
+			   pixel res_bad, pixel res_should_be)
 {
-    int err = 0;
-    int i, j;
-    int badi = 0;
-    int badj = 0;
-    pixel res_bad = { 0, 0, 0}, res_should_be = {0, 0, 0};
+    printf("\n");
+    printf("ERROR: Dimension=%d, %d errors\n", dim, err);    
+    printf("E.g., The following pixel has the wrong value:\n");
+    printf("result[%d][%d].{red,green,blue} = {%d,%d,%d}\n",
+	   badi, badj, res_bad.red, res_bad.green, res_bad.blue);
+    printf("It should be:\n");
+    printf("img[%d][%d].{red,green,blue} = {%d,%d,%d}\n",
+	   badi, badj, res_should_be.red, res_should_be.green, res_should_be.blue);
+}
 
-    /* return 1 if the original image has been changed */
-    if (check_orig(dim)) 
-	return 1;
+static void report_motion(int dim, int err, int badi, int badj,
+			  pixel wrong, pixel right)
+{
+    printf("\n");
+    printf("ERROR: Dimension=%d, %d errors\n", dim, err);    
+    printf("E.g., \n");
+    printf("You have dst[%d][%d].{red,green,blue} = {%d,%d,%d}\n",
+	   badi, badj, wrong.red, wrong.green, wrong.blue);
+    printf("It should be dst[%d][%d].{red,green,blue} = {%d,%d,%d}\n",
+	   badi, badj, right.red, right.green, right.blue);
+}
+
+static pixel check_weighted_sum(int dim, int i, int j, pixel *src);
+
+/* expected_complex - Compute complex(orig) into tmp */
+static void expected_complex(int dim)
+{
+    int i, j;
 
     // Rotate, flip, then grayscale
 
@@ -325,7 +439,154 @@ static int check_complex(int dim, int save_images)
 							 (int)orig[RIDX(i, j, dim)].blue) / 3;
 	
       }
+}
+
+/* expected_motion - Compute motion(orig) into tmp */
+static void expected_motion(int dim)
+{
+    int i, j;
+
+    for (i = 0; i < dim; i++)
+      for (j = 0; j < dim; j++)
+        tmp[RIDX(i,j,dim)] = check_weighted_sum(dim, i, j, orig);
+}
+
+/*
+ * Golden checks. The expected output for each kind, dim and input
+ * image is computed once, and only its hash and tile hashes (see
+ * hash.h) are kept. A result is then checked by hashing it on the
+ * pool, and only the tiles whose hashes differ are recomputed, pixel
+ * by pixel, for the error report.
+ */
+#define GOLDEN_MAX 256
+
+typedef struct {
+    int motion;         /* 0 = complex, 1 = motion */
+    int dim;
+    uint64_t input;     /* hash of orig */
+    uint64_t hash;      /* hash of the expected output */
+    uint64_t *tiles;    /* and of each of its tiles */
+} golden_t;
+
+static golden_t golden[GOLDEN_MAX];
+static int golden_count = 0, golden_next = 0;
+static uint64_t *golden_scratch = NULL;  /* tile hashes of orig or result */
+
+/* expected_pixel - Pixel (i,j) of complex(orig) or motion(orig) */
+static pixel expected_pixel(int motion, int dim, int i, int j)
+{
+    pixel p, gray;
+
+    if (motion)
+	return check_weighted_sum(dim, i, j, orig);
+    p = orig[RIDX(dim - 1 - j, dim - 1 - i, dim)];
+    gray.red = gray.green = gray.blue = ((int) p.red + (int) p.green + (int) p.blue) / 3;
+    return gray;
+}
+
+/* golden_lookup - The golden entry for orig, computing it on a miss */
+static golden_t *golden_lookup(int motion, int dim)
+{
+    uint64_t input = hash_image(dim, orig, golden_scratch);
+    golden_t *g;
+    int k, n = HASH_TILES(dim);
+
+    for (k = 0; k < golden_count; k++)
+	if (golden[k].motion == motion && golden[k].dim == dim &&
+	    golden[k].input == input)
+	    return &golden[k];
+
+    g = &golden[golden_next];
+    golden_next = (golden_next + 1) % GOLDEN_MAX;
+    if (golden_count < GOLDEN_MAX)
+	golden_count++;
+    else
+	free(g->tiles);
+    if ((g->tiles = malloc((size_t) n * n * sizeof(uint64_t))) == NULL) {
+	fprintf(stderr, "Fatal error.  malloc failed in golden_lookup\n");
+	exit(1);
+    }
+
+    if (motion)
+	expected_motion(dim);
+    else
+	expected_complex(dim);
+    g->motion = motion;
+    g->dim = dim;
+    g->input = input;
+    g->hash = hash_image(dim, tmp, g->tiles);
+    return g;
+}
+
+/*
+ * check_golden - Check result against the golden hashes of complex
+ *     or motion of orig, and report the wrong pixels of any tile that
+ *     doesn't match. Returns the number of wrong pixels.
+ */
+static int check_golden(int motion, int dim)
+{
+    int n = HASH_TILES(dim), t, i, j, i1, j1;
+    int err = 0, badi = 0, badj = 0;
+    pixel right = {0, 0, 0}, wrong = {0, 0, 0}, e;
+    golden_t *g;
+
+    if (golden_scratch == NULL) {
+	golden_scratch = malloc((size_t) HASH_TILES(MAX_DIM) * HASH_TILES(MAX_DIM) *
+				sizeof(uint64_t));
+	if (golden_scratch == NULL) {
+	    fprintf(stderr, "Fatal error.  malloc failed in check_golden\n");
+	    exit(1);
+	}
+    }
+
+    g = golden_lookup(motion, dim);
+    if (hash_image(dim, result, golden_scratch) == g->hash)
+	return 0;
+
+    for (t = 0; t < n * n; t++) {
+	if (golden_scratch[t] == g->tiles[t])
+	    continue;
+	i1 = (t / n + 1) * HASH_TILE < dim ? (t / n + 1) * HASH_TILE : dim;
+	j1 = (t % n + 1) * HASH_TILE < dim ? (t % n + 1) * HASH_TILE : dim;
+	for (i = (t / n) * HASH_TILE; i < i1; i++)
+	    for (j = (t % n) * HASH_TILE; j < j1; j++) {
+		e = expected_pixel(motion, dim, i, j);
+		if (compare_pixels(result[RIDX(i,j,dim)], e)) {
+		    err++;
+		    badi = i;
+		    badj = j;
+		    wrong = result[RIDX(i,j,dim)];
+		    right = e;
+		}
+	    }
+    }
+
+    if (err && motion)
+	report_motion(dim, err, badi, badj, wrong, right);
+    else if (err)
+	report_complex(dim, err, badi, badj, wrong, right);
+    return err;
+}
+
+/* 
+ * check_complex - Make sure the complex actually works. 
+ */
+static int check_complex(int dim, int save_images)
+{
+    int err = 0;
+    int i, j;
+    int badi = 0;
+    int badj = 0;
+    pixel res_bad = { 0, 0, 0}, res_should_be = {0, 0, 0};
+
+    /* return 1 if the original image has been changed */
+    if (check_orig(dim)) 
+	return 1;
 
+    if (golden_checks && !save_images)
+	return check_golden(0, dim);
+
+    expected_complex(dim);
 
     if (save_images) {
       write_image(dim, "complex", "orig", orig);
@@ -345,16 +606,8 @@ static int check_complex(int dim, int save_images)
         }
       }
 
-    if (err) {
-	printf("\n");
-	printf("ERROR: Dimension=%d, %d errors\n", dim, err);    
-	printf("E.g., The following pixel has the wrong value:\n");
-	printf("result[%d][%d].{red,green,blue} = {%d,%d,%d}\n",
-	       badi, badj, res_bad.red, res_bad.green, res_bad.blue);
-	printf("It should be:\n");
-	printf("img[%d][%d].{red,green,blue} = {%d,%d,%d}\n",
-	       badi, badj, res_should_be.red, res_should_be.green, res_should_be.blue);
-    }
+    if (err)
+	report_complex(dim, err, badi, badj, res_bad, res_should_be);
     
     return err;
 }
@@ -400,9 +653,10 @@ static int check_motion(int dim, int save_images) {
     if (check_orig(dim)) 
 	return 1;
 
-    for (i = 0; i < dim; i++)
-      for (j = 0; j < dim; j++)
-        tmp[RIDX(i,j,dim)] = check_weighted_sum(dim, i, j, orig);
+    if (golden_checks && !save_images)
+	return check_golden(1, dim);
+
+    expected_motion(dim);
 
     if (save_images) {
       write_image(dim, "motion", "orig", orig);
@@ -423,15 +677,8 @@ static int check_motion(int dim, int save_images) {
 	}
     }
 
-    if (err) {
-	printf("\n");
-	printf("ERROR: Dimension=%d, %d errors\n", dim, err);    
-	printf("E.g., \n");
-	printf("You have dst[%d][%d].{red,green,blue} = {%d,%d,%d}\n",
-	       badi, badj, wrong.red, wrong.green, wrong.blue);
-	printf("It should be dst[%d][%d].{red,green,blue} = {%d,%d,%d}\n",
-	       badi, badj, right.red, right.green, right.blue);
-    }
+    if (err)
+	report_motion(dim, err, badi, badj, wrong, right);
 
     return err;
 }
@@ -469,20 +716,95 @@ void motion_wrapper(void *arglist[])
     return;
 }
 
+/*
+ * print_counters - Print the IPC and the per pixel counts of every
+ *     available event for the fastest sample at each dimension. IPC
+ *     uses core cycles if they can be counted, the CPE otherwise.
+ */
+static void print_counters(perf_sample *counts, double *cpes, int *dims)
+{
+    int i, e;
+    double pixels, cycles;
+
+    if (counts[0].valid[PERF_INSTRUCTIONS]) {
+	printf("IPC\t");
+	for (i = 0; i < DIM_CNT; i++) {
+	    pixels = (double) dims[i] * dims[i];
+	    cycles = counts[i].valid[PERF_CYCLES] ?
+		counts[i].count[PERF_CYCLES] : cpes[i] * pixels;
+	    printf("\t%.2f", cycles > 0.0 ? counts[i].count[PERF_INSTRUCTIONS] / cycles : 0.0);
+	}
+	printf("\n");
+    }
+
+    for (e = PERF_CACHE_REFS; e < PERF_NEVENTS; e++) {
+	if (!counts[0].valid[e])
+	    continue;
+	printf("%s/px", perf_name(e));
+	for (i = 0; i < DIM_CNT; i++)
+	    printf("\t%.3f", counts[i].count[e] / ((double) dims[i] * dims[i]));
+	printf("\n");
+    }
+}
+
 void run_complex_benchmark(int idx, int dim)
 {
   benchmarks_complex[idx].complex_funct(dim, orig, result);
 }
 
+/*
+ * measure_complex_funct - Returns the CPE of complex function f on a
+ *     freshly created dim x dim image
+ */
+static double measure_complex_funct(complex_test_func f, int dim)
+{
+    double num_cycles;
+    int tmpdim = dim;
+    void *arglist[4];
+    double dimension = (double) dim;
+    double work = dimension*dimension;
+#ifdef DEBUG
+    printf("DEBUG: dimension=%.1f\n",dimension);
+    printf("DEBUG: work=%.1f\n",work);
+#endif
+
+    create(dim); /* sets orig and result for this dim */
+    arglist[0] = (void *) f;
+    arglist[1] = (void *) &tmpdim;
+    arglist[2] = (void *) orig;
+    arglist[3] = (void *) result;
+    num_cycles = fcyc_v((test_funct_v)&complex_wrapper, arglist); 
+    return num_cycles/work;
+}
+
+/*
+ * measure_complex - Returns the CPE of complex benchmark idx on a
+ *     freshly created dim x dim image
+ */
+static double measure_complex(int bench_index, int dim)
+{
+    return measure_complex_funct(benchmarks_complex[bench_index].complex_funct, dim);
+}
+
 void test_complex(int bench_index) 
 {
     int i;
     int test_num;
     char *description = benchmarks_complex[bench_index].description;
+    perf_sample counts[DIM_CNT];
   
     for (test_num = 0; test_num < DIM_CNT; test_num++) {
       int dim;
 
+	/* Check for a dimension that leaves partial blocks */
+	create(RAGGED_DIM);
+	run_complex_benchmark(bench_index, RAGGED_DIM);
+	if (check_complex(RAGGED_DIM, 0)) {
+	    printf("Benchmark \"%s\" failed correctness check for dimension %d.\n",
+		   benchmarks_complex[bench_index].description, RAGGED_DIM);
+	    return;
+	}
+
 	/* Check for odd dimension */
 	create(ODD_DIM);
 	run_complex_benchmark(bench_index, ODD_DIM);
@@ -508,27 +830,10 @@ void test_complex(int bench_index)
 	}
 
 	/* Measure CPE */
-	{
-	    double num_cycles, cpe;
-	    int tmpdim = dim;
-	    void *arglist[4];
-	    double dimension = (double) dim;
-	    double work = dimension*dimension;
-#ifdef DEBUG
-	    printf("DEBUG: dimension=%.1f\n",dimension);
-	    printf("DEBUG: work=%.1f\n",work);
-#endif
-            
-	    arglist[0] = (void *) benchmarks_complex[bench_index].complex_funct;
-	    arglist[1] = (void *) &tmpdim;
-	    arglist[2] = (void *) orig;
-	    arglist[3] = (void *) result;
-
-	    create(dim);
-	    num_cycles = fcyc_v((test_funct_v)&complex_wrapper, arglist); 
-	    cpe = num_cycles/work;
-	    benchmarks_complex[bench_index].cpes[test_num] = cpe;
-	}
+	benchmarks_complex[bench_index].cpes[test_num] =
+	    measure_complex(bench_index, dim);
+	if (counters)
+	    fcyc_counters(&counts[test_num]);
     }
 
     /* 
@@ -546,6 +851,9 @@ void test_complex(int bench_index)
     }
     printf("\n");
 
+    if (counters)
+	print_counters(counts, benchmarks_complex[bench_index].cpes, test_dim_complex);
+
     printf("Baseline CPEs");
     for (i = 0; i < DIM_CNT; i++) {
 	printf("\t%.1f", complex_baseline_cpes[i]);
@@ -592,11 +900,45 @@ void run_motion_benchmark(int idx, int dim)
   benchmarks_motion[idx].motion_funct(dim, orig, result);
 }
 
+/*
+ * measure_motion_funct - Returns the CPE of motion function f on a
+ *     freshly created dim x dim image
+ */
+static double measure_motion_funct(motion_test_func f, int dim)
+{
+    double num_cycles;
+    int tmpdim = dim;
+    void *arglist[4];
+    double dimension = (double) dim;
+    double work = dimension*dimension;
+#ifdef DEBUG
+    printf("DEBUG: dimension=%.1f\n",dimension);
+    printf("DEBUG: work=%.1f\n",work);
+#endif
+    create(dim); /* sets orig and result for this dim */
+    arglist[0] = (void *) f;
+    arglist[1] = (void *) &tmpdim;
+    arglist[2] = (void *) orig;
+    arglist[3] = (void *) result;
+    num_cycles = fcyc_v((test_funct_v)&motion_wrapper, arglist); 
+    return num_cycles/work;
+}
+
+/*
+ * measure_motion - Returns the CPE of motion benchmark idx on a
+ *     freshly created dim x dim image
+ */
+static double measure_motion(int bench_index, int dim)
+{
+    return measure_motion_funct(benchmarks_motion[bench_index].motion_funct, dim);
+}
+
 void test_motion(int bench_index) 
 {
     int i;
     int test_num;
     char *description = benchmarks_motion[bench_index].description;
+    perf_sample counts[DIM_CNT];
   
     for(test_num=0; test_num < DIM_CNT; test_num++) {
 	int dim;
@@ -626,26 +968,10 @@ void test_motion(int bench_index)
 	}
 
 	/* Measure CPE */
-	{
-	    double num_cycles, cpe;
-	    int tmpdim = dim;
-	    void *arglist[4];
-	    double dimension = (double) dim;
-	    double work = dimension*dimension;
-#ifdef DEBUG
-	    printf("DEBUG: dimension=%.1f\n",dimension);
-	    printf("DEBUG: work=%.1f\n",work);
-#endif
-	    arglist[0] = (void *) benchmarks_motion[bench_index].motion_funct;
-	    arglist[1] = (void *) &tmpdim;
-	    arglist[2] = (void *) orig;
-	    arglist[3] = (void *) result;
-        
-	    create(dim);
-            num_cycles = fcyc_v((test_funct_v)&motion_wrapper, arglist); 
-	    cpe = num_cycles/work;
-	    benchmarks_motion[bench_index].cpes[test_num] = cpe;
-	}
+	benchmarks_motion[bench_index].cpes[test_num] =
+	    measure_motion(bench_index, dim);
+	if (counters)
+	    fcyc_counters(&counts[test_num]);
     }
 
     /* Print results as a table */
@@ -661,6 +987,9 @@ void test_motion(int bench_index)
     }
     printf("\n");
 
+    if (counters)
+	print_counters(counts, benchmarks_motion[bench_index].cpes, test_dim_motion);
+
     printf("Baseline CPEs");
     for (i = 0; i < DIM_CNT; i++) {
 	printf("\t%.1f", motion_baseline_cpes[i]);
@@ -698,80 +1027,2352 @@ void test_motion(int bench_index)
 }
 
 
-void usage(char *progname) 
+void planar_wrapper(void *arglist[]) 
 {
-    fprintf(stderr, "Usage: %s [-hqg] [-f <func_file>] [-d <dump_file>]\n", progname);    
-    fprintf(stderr, "Options:\n");
-    fprintf(stderr, "  -h         Print this message\n");
-    fprintf(stderr, "  -i         Save test images as \".image\" files\n");
-    fprintf(stderr, "  -I         Save all images as \".image\" files\n");
-    fprintf(stderr, "  -m <mode>  Pick original image: gradient, squares, lines, or random\n");
-    fprintf(stderr, "  -q         Quit after dumping (use with -d )\n");
-    fprintf(stderr, "  -g         Autograder mode: checks only complex() and motion()\n");
-    fprintf(stderr, "  -f <file>  Get test function names from dump file <file>\n");
-    fprintf(stderr, "  -d <file>  Emit a dump file <file> for later use with -f\n");
-    exit(EXIT_FAILURE);
+    planar_test_func f;
+
+    f = (planar_test_func) arglist[0];
+    (*f)((planar_image *) arglist[1], (planar_image *) arglist[2]);
 }
 
+/* Same as planar_wrapper, but converts from orig and back to result */
+void planar_convert_wrapper(void *arglist[]) 
+{
+    planar_test_func f;
+    planar_image *src, *dst;
 
+    f = (planar_test_func) arglist[0];
+    src = (planar_image *) arglist[1];
+    dst = (planar_image *) arglist[2];
 
-int main(int argc, char *argv[])
+    planar_from_pixels((pixel *) arglist[3], src);
+    (*f)(src, dst);
+    planar_to_pixels(dst, (pixel *) arglist[4]);
+}
+
+/*
+ * run_planar - Run planar kernel f on a copy of orig and convert the
+ *     output back into result, ready for check_complex/check_motion
+ */
+static void run_planar(planar_test_func f, int dim)
 {
-    int i;
-    int quit_after_dump = 0;
-    int skip_studentname_check = 0;
-    int autograder = 0;
-    int seed = 1729;
-    char c = '0';
-    char *bench_func_file = NULL;
-    char *func_dump_file = NULL;
+    planar_image *src = planar_alloc(dim);
+    planar_image *dst = planar_alloc(dim);
+
+    planar_from_pixels(orig, src);
+    f(src, dst);
+    planar_to_pixels(dst, result);
+    planar_free(src);
+    planar_free(dst);
+}
 
-    /* register all the defined functions */
-    register_complex_functions();
-    register_motion_functions();
+/*
+ * measure_planar - Measure the CPE of planar kernel f on a dim x dim
+ *     image, both on its own (returned) and including the conversion
+ *     from orig and back to result (*convert_cpe)
+ */
+static double measure_planar(planar_test_func f, int dim, double *convert_cpe)
+{
+    double work = (double) dim * dim;
+    double cpe;
+    void *arglist[5];
+    planar_image *src, *dst;
+
+    create(dim);
+    src = planar_alloc(dim);
+    dst = planar_alloc(dim);
+    planar_from_pixels(orig, src);
+
+    arglist[0] = (void *) f;
+    arglist[1] = (void *) src;
+    arglist[2] = (void *) dst;
+    arglist[3] = (void *) orig;
+    arglist[4] = (void *) result;
+
+    cpe = fcyc_v((test_funct_v)&planar_wrapper, arglist) / work;
+    *convert_cpe = fcyc_v((test_funct_v)&planar_convert_wrapper, arglist) / work;
+
+    planar_free(src);
+    planar_free(dst);
+    return cpe;
+}
 
-    /* parse command line args */
-    while ((c = getopt(argc, argv, "iIm:tgqf:d:s:h")) != -1)
-	switch (c) {
+/*
+ * print_planar - Print the table for one planar benchmark
+ */
+static void print_planar(char *kind, bench_t *bench, int *dims,
+			 double *convert_cpes, double *baseline_cpes)
+{
+    int i;
+    double prod, convert_prod;
 
-        case 'i':
-          save_test_image_files = 1;
-          break;
+    printf("%s: Version = %s:\n", kind, bench->description);
+    printf("Dim\t");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%d", dims[i]);
+    printf("\tMean\n");
 
-        case 'I':
-          save_all_image_files = 1;
-          break;
+    printf("Planar CPEs");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%.1f", bench->cpes[i]);
+    printf("\n");
 
-        case 'm':
-          if (!strcmp(optarg, "gradient")) {
-            image_mode = GRADIENT;
-          } else if (!strcmp(optarg, "squares")) {
-            image_mode = SQUARES;
-          } else if (!strcmp(optarg, "lines")) {
-            image_mode = LINES;
-          } else if (!strcmp(optarg, "random")) {
-            image_mode = RANDOM;
-          } else {
-            fprintf(stderr, "unrecognized image mode: %s\n", optarg);
-            exit(1);
-          }
-          break;
-	  
-	case 't': /* skip student name check (hidden flag) */
-	    skip_studentname_check = 1;
-	    break;
+    printf("+Convert CPEs");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%.1f", convert_cpes[i]);
+    printf("\n");
 
-	case 's': /* seed for random number generator (hidden flag) */
-	    seed = atoi(optarg);
-	    break;
+    printf("Baseline CPEs");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%.1f", baseline_cpes[i]);
+    printf("\n");
 
-	case 'g': /* autograder mode (checks only complex() and motion()) */
-	    autograder = 1;
-	    break;
+    prod = convert_prod = 1.0;
+    printf("Speedup\t");
+    for (i = 0; i < DIM_CNT; i++) {
+	prod *= baseline_cpes[i]/bench->cpes[i];
+	printf("\t%.1f", baseline_cpes[i]/bench->cpes[i]);
+    }
+    printf("\t%.1f\n", pow(prod, 1.0/(double) DIM_CNT));
 
-	case 'q':
-	    quit_after_dump = 1;
-	    break;
+    printf("+Convert");
+    for (i = 0; i < DIM_CNT; i++) {
+	convert_prod *= baseline_cpes[i]/convert_cpes[i];
+	printf("\t%.1f", baseline_cpes[i]/convert_cpes[i]);
+    }
+    printf("\t%.1f\n\n", pow(convert_prod, 1.0/(double) DIM_CNT));
+}
+
+/*
+ * test_planar_complex - Check and measure planar complex benchmark
+ *     bench_index, with and without the conversion cost
+ */
+void test_planar_complex(int bench_index)
+{
+    int i, dim;
+    double convert_cpes[DIM_CNT];
+    bench_t *bench = &benchmarks_planar_complex[bench_index];
+
+    for (i = 0; i < DIM_CNT; i++) {
+	/* Check for odd dimension, then the test dimension */
+	create(ODD_DIM);
+	run_planar(bench->planar_funct, ODD_DIM);
+	if (check_complex(ODD_DIM, save_test_image_files)) {
+	    printf("Benchmark \"%s\" failed correctness check for dimension %d.\n",
+		   bench->description, ODD_DIM);
+	    return;
+	}
+
+	dim = test_dim_complex[i];
+	create(dim);
+	run_planar(bench->planar_funct, dim);
+	if (check_complex(dim, save_all_image_files)) {
+	    printf("Benchmark \"%s\" failed correctness check for dimension %d.\n",
+		   bench->description, dim);
+	    return;
+	}
+
+	bench->cpes[i] = measure_planar(bench->planar_funct, dim, &convert_cpes[i]);
+    }
+
+    print_planar("Planar complex", bench, test_dim_complex, convert_cpes,
+		 complex_baseline_cpes);
+}
+
+/*
+ * test_planar_motion - Check and measure planar motion benchmark
+ *     bench_index, with and without the conversion cost
+ */
+void test_planar_motion(int bench_index)
+{
+    int i, dim;
+    double convert_cpes[DIM_CNT];
+    bench_t *bench = &benchmarks_planar_motion[bench_index];
+
+    for (i = 0; i < DIM_CNT; i++) {
+	create(ODD_DIM);
+	run_planar(bench->planar_funct, ODD_DIM);
+	if (check_motion(ODD_DIM, save_test_image_files)) {
+	    printf("Benchmark \"%s\" failed correctness check for dimension %d.\n",
+		   bench->description, ODD_DIM);
+	    return;
+	}
+
+	dim = test_dim_motion[i];
+	create(dim);
+	run_planar(bench->planar_funct, dim);
+	if (check_motion(dim, save_all_image_files)) {
+	    printf("Benchmark \"%s\" failed correctness check for dimension %d.\n",
+		   bench->description, dim);
+	    return;
+	}
+
+	bench->cpes[i] = measure_planar(bench->planar_funct, dim, &convert_cpes[i]);
+    }
+
+    print_planar("Planar motion", bench, test_dim_motion, convert_cpes,
+		 motion_baseline_cpes);
+}
+
+/* 8 bit copies of orig and result for the pixel8 kernels */
+static pixel8 *orig8 = NULL;
+static pixel8 *result8 = NULL;
+
+/*
+ * create8 - create(dim), then cut orig down to 8 bit channel values
+ *     and copy it into orig8, so the 16 bit checks apply unchanged
+ */
+static void create8(int dim)
+{
+    int k;
+
+    if (orig8 == NULL) {
+	orig8 = huge_alloc(MAX_DIM * MAX_DIM * sizeof(pixel8));
+	result8 = huge_alloc(MAX_DIM * MAX_DIM * sizeof(pixel8));
+    }
+
+    create(dim);
+    for (k = 0; k < dim * dim; k++) {
+	orig[k].red = copy_of_orig[k].red = orig8[k].red = orig[k].red >> 8;
+	orig[k].green = copy_of_orig[k].green = orig8[k].green = orig[k].green >> 8;
+	orig[k].blue = copy_of_orig[k].blue = orig8[k].blue = orig[k].blue >> 8;
+    }
+}
+
+/* run_pixel8 - Run f on orig8 and widen its output into result */
+static void run_pixel8(pixel8_test_func f, int dim)
+{
+    int k;
+
+    f(dim, orig8, result8);
+    for (k = 0; k < dim * dim; k++) {
+	result[k].red = result8[k].red;
+	result[k].green = result8[k].green;
+	result[k].blue = result8[k].blue;
+    }
+}
+
+void pixel8_wrapper(void *arglist[]) 
+{
+    pixel8_test_func f;
+
+    f = (pixel8_test_func) arglist[0];
+    (*f)(*((int *) arglist[1]), (pixel8 *) arglist[2], (pixel8 *) arglist[3]);
+}
+
+/* measure_pixel8 - CPE of pixel8 kernel f on a dim x dim image */
+static double measure_pixel8(pixel8_test_func f, int dim)
+{
+    int tmpdim = dim;
+    void *arglist[4];
+
+    create8(dim);
+    arglist[0] = (void *) f;
+    arglist[1] = (void *) &tmpdim;
+    arglist[2] = (void *) orig8;
+    arglist[3] = (void *) result8;
+    return fcyc_v((test_funct_v)&pixel8_wrapper, arglist) / ((double) dim * dim);
+}
+
+/*
+ * print_pixel8 - Print the table for one pixel8 benchmark, next to
+ *     the 16 bit CPEs of the graded kernel
+ */
+static void print_pixel8(char *kind, bench_t *bench, int *dims,
+			 double *wide_cpes, double *baseline_cpes)
+{
+    int i;
+    double prod = 1.0, wide_prod = 1.0;
+
+    printf("%s: Version = %s:\n", kind, bench->description);
+    printf("Dim\t");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%d", dims[i]);
+    printf("\tMean\n");
+
+    printf("8 bit CPEs");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%.1f", bench->cpes[i]);
+    printf("\n");
+
+    printf("16 bit CPEs");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%.1f", wide_cpes[i]);
+    printf("\n");
+
+    printf("Baseline CPEs");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%.1f", baseline_cpes[i]);
+    printf("\n");
+
+    printf("Speedup\t");
+    for (i = 0; i < DIM_CNT; i++) {
+	prod *= baseline_cpes[i]/bench->cpes[i];
+	printf("\t%.1f", baseline_cpes[i]/bench->cpes[i]);
+    }
+    printf("\t%.1f\n", pow(prod, 1.0/(double) DIM_CNT));
+
+    printf("vs 16 bit");
+    for (i = 0; i < DIM_CNT; i++) {
+	wide_prod *= wide_cpes[i]/bench->cpes[i];
+	printf("\t%.1f", wide_cpes[i]/bench->cpes[i]);
+    }
+    printf("\t%.1f\n\n", pow(wide_prod, 1.0/(double) DIM_CNT));
+}
+
+/*
+ * test_pixel8_complex - Check and measure pixel8 complex benchmark
+ *     bench_index against complex() on the same 16 bit images
+ */
+void test_pixel8_complex(int bench_index)
+{
+    int i, dim;
+    double wide_cpes[DIM_CNT];
+    bench_t *bench = &benchmarks_pixel8_complex[bench_index];
+
+    for (i = 0; i < DIM_CNT; i++) {
+	/* Check for odd dimension, then the test dimension */
+	create8(ODD_DIM);
+	run_pixel8(bench->pixel8_funct, ODD_DIM);
+	if (check_complex(ODD_DIM, save_test_image_files)) {
+	    printf("Benchmark \"%s\" failed correctness check for dimension %d.\n",
+		   bench->description, ODD_DIM);
+	    return;
+	}
+
+	dim = test_dim_complex[i];
+	create8(dim);
+	run_pixel8(bench->pixel8_funct, dim);
+	if (check_complex(dim, save_all_image_files)) {
+	    printf("Benchmark \"%s\" failed correctness check for dimension %d.\n",
+		   bench->description, dim);
+	    return;
+	}
+
+	bench->cpes[i] = measure_pixel8(bench->pixel8_funct, dim);
+	wide_cpes[i] = measure_complex_funct(complex, dim);
+    }
+
+    print_pixel8("8 bit complex", bench, test_dim_complex, wide_cpes,
+		 complex_baseline_cpes);
+}
+
+/*
+ * test_pixel8_motion - Check and measure pixel8 motion benchmark
+ *     bench_index against motion() on the same 16 bit images
+ */
+void test_pixel8_motion(int bench_index)
+{
+    int i, dim;
+    double wide_cpes[DIM_CNT];
+    bench_t *bench = &benchmarks_pixel8_motion[bench_index];
+
+    for (i = 0; i < DIM_CNT; i++) {
+	create8(ODD_DIM);
+	run_pixel8(bench->pixel8_funct, ODD_DIM);
+	if (check_motion(ODD_DIM, save_test_image_files)) {
+	    printf("Benchmark \"%s\" failed correctness check for dimension %d.\n",
+		   bench->description, ODD_DIM);
+	    return;
+	}
+
+	dim = test_dim_motion[i];
+	create8(dim);
+	run_pixel8(bench->pixel8_funct, dim);
+	if (check_motion(dim, save_all_image_files)) {
+	    printf("Benchmark \"%s\" failed correctness check for dimension %d.\n",
+		   bench->description, dim);
+	    return;
+	}
+
+	bench->cpes[i] = measure_pixel8(bench->pixel8_funct, dim);
+	wide_cpes[i] = measure_motion_funct(motion, dim);
+    }
+
+    print_pixel8("8 bit motion", bench, test_dim_motion, wide_cpes,
+		 motion_baseline_cpes);
+}
+
+/*
+ * complex_motion_seq - complex() and then motion() through the stage
+ *     image, the pipeline that the fused kernels replace
+ */
+static void complex_motion_seq(int dim, pixel *src, pixel *dst)
+{
+    complex(dim, src, stage);
+    motion(dim, stage, dst);
+}
+
+/*
+ * check_fused - Make sure the fused kernel's result matches running
+ *     complex() and then motion() on orig
+ */
+static int check_fused(int dim)
+{
+    int i, j, err = 0;
+    int badi = 0, badj = 0;
+    pixel right = {0, 0, 0}, wrong = {0, 0, 0};
+
+    /* return 1 if original image has been changed */
+    if (check_orig(dim))
+	return 1;
+
+    complex_motion_seq(dim, orig, tmp);
+
+    for (i = 0; i < dim; i++)
+	for (j = 0; j < dim; j++)
+	    if (compare_pixels(result[RIDX(i,j,dim)], tmp[RIDX(i,j,dim)])) {
+		err++;
+		badi = i;
+		badj = j;
+		wrong = result[RIDX(i,j,dim)];
+		right = tmp[RIDX(i,j,dim)];
+	    }
+
+    if (err) {
+	printf("\n");
+	printf("ERROR: Dimension=%d, %d errors\n", dim, err);
+	printf("E.g., \n");
+	printf("You have dst[%d][%d].{red,green,blue} = {%d,%d,%d}\n",
+	       badi, badj, wrong.red, wrong.green, wrong.blue);
+	printf("complex() then motion() give dst[%d][%d].{red,green,blue} = {%d,%d,%d}\n",
+	       badi, badj, right.red, right.green, right.blue);
+    }
+
+    return err;
+}
+
+/*
+ * test_fused - Check fused benchmark bench_index against complex()
+ *     then motion(), and measure its CPE next to the CPE of the two
+ *     kernels run one after the other
+ */
+void test_fused(int bench_index)
+{
+    int i, dim;
+    double prod = 1.0, seq_cpes[DIM_CNT];
+    bench_t *bench = &benchmarks_fused[bench_index];
+
+    for (i = 0; i < DIM_CNT; i++) {
+	/* Check for odd dimension, then the test dimension */
+	create(ODD_DIM);
+	bench->complex_funct(ODD_DIM, orig, result);
+	if (check_fused(ODD_DIM)) {
+	    printf("Benchmark \"%s\" failed correctness check for dimension %d.\n",
+		   bench->description, ODD_DIM);
+	    return;
+	}
+
+	dim = test_dim_complex[i];
+	create(dim);
+	bench->complex_funct(dim, orig, result);
+	if (check_fused(dim)) {
+	    printf("Benchmark \"%s\" failed correctness check for dimension %d.\n",
+		   bench->description, dim);
+	    return;
+	}
+
+	bench->cpes[i] = measure_complex_funct(bench->complex_funct, dim);
+	seq_cpes[i] = measure_complex_funct(complex_motion_seq, dim);
+    }
+
+    printf("Fused: Version = %s:\n", bench->description);
+    printf("Dim\t");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%d", test_dim_complex[i]);
+    printf("\tMean\n");
+
+    printf("Your CPEs");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%.1f", bench->cpes[i]);
+    printf("\n");
+
+    printf("Sequential CPEs");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%.1f", seq_cpes[i]);
+    printf("\n");
+
+    printf("Speedup\t");
+    for (i = 0; i < DIM_CNT; i++) {
+	prod *= seq_cpes[i]/bench->cpes[i];
+	printf("\t%.1f", seq_cpes[i]/bench->cpes[i]);
+    }
+    printf("\t%.1f\n\n", pow(prod, 1.0/(double) DIM_CNT));
+}
+
+/* Streaming mode parameters */
+#define STREAM_BAND 256     /* rows per band */
+#define STREAM_SAMPLES 4096 /* output pixels checked per kernel */
+
+/*
+ * stream_sample - Pick sample k of the pixels to check in a rows x
+ *     cols image: first the corners and the pixels next to them,
+ *     where the windows are cut off, then random pixels
+ */
+static void stream_sample(int k, int rows, int cols, int *i, int *j)
+{
+    if (k < 9) {
+	*i = (k / 3 == 0) ? 0 : rows - 3 + k / 3;
+	*j = (k % 3 == 0) ? 0 : cols - 3 + k % 3;
+	*i = max(*i, 0);
+	*j = max(*j, 0);
+    }
+    else {
+	*i = rand() % rows;
+	*j = rand() % cols;
+    }
+}
+
+/*
+ * check_stream_complex - Check sampled pixels of out = complex(in)
+ */
+static int check_stream_complex(image_file *in, image_file *out)
+{
+    int k, i, j, gray, err = 0;
+    image_band inb, outb;
+    pixel p, q;
+
+    for (k = 0; k < STREAM_SAMPLES; k++) {
+	stream_sample(k, in->rows, in->cols, &i, &j);
+	p = image_map(in, i, i + 1, &inb)[j];
+	q = image_map(out, in->cols - 1 - j, in->cols - j, &outb)[in->rows - 1 - i];
+	image_unmap(&inb);
+	image_unmap(&outb);
+
+	gray = ((int)p.red + (int)p.green + (int)p.blue) / 3;
+	if (q.red != gray || q.green != gray || q.blue != gray) {
+	    if (err++ == 0)
+		printf("ERROR: complex of in[%d][%d] is {%d,%d,%d}, should be %d\n",
+		       i, j, q.red, q.green, q.blue, gray);
+	}
+    }
+    return err;
+}
+
+/*
+ * check_stream_motion - Check sampled pixels of out = motion(in)
+ */
+static int check_stream_motion(image_file *in, image_file *out)
+{
+    int k, i, j, ii, jj, n, err = 0;
+    int r, g, b;
+    image_band inb, outb;
+    pixel *src, q;
+
+    for (k = 0; k < STREAM_SAMPLES; k++) {
+	stream_sample(k, in->rows, in->cols, &i, &j);
+	src = image_map(in, i, min(i + 3, in->rows), &inb);
+	q = image_map(out, i, i + 1, &outb)[j];
+
+	r = g = b = n = 0;
+	for (ii = 0; ii < 3 && i + ii < in->rows; ii++)
+	    for (jj = 0; jj < 3 && j + jj < in->cols; jj++) {
+		n++;
+		r += src[RIDX(ii, j + jj, in->cols)].red;
+		g += src[RIDX(ii, j + jj, in->cols)].green;
+		b += src[RIDX(ii, j + jj, in->cols)].blue;
+	    }
+	image_unmap(&inb);
+	image_unmap(&outb);
+
+	if (q.red != r / n || q.green != g / n || q.blue != b / n) {
+	    if (err++ == 0)
+		printf("ERROR: motion[%d][%d] is {%d,%d,%d}, should be {%d,%d,%d}\n",
+		       i, j, q.red, q.green, q.blue, r / n, g / n, b / n);
+	}
+    }
+    return err;
+}
+
+/*
+ * test_stream - Stream complex and motion over a random rows x cols
+ *     image through mmap'd image files, check sampled output pixels
+ *     and report CPEs and the peak resident memory
+ */
+static void test_stream(int rows, int cols)
+{
+    char *names[3] = {"stream_orig.img", "stream_complex.img", "stream_motion.img"};
+    image_file *in, *cout, *mout;
+    image_band band;
+    pixel *p;
+    int r0, r1, k;
+    long n;
+    double work = (double) rows * cols;
+    struct rusage usage;
+
+    in = image_create(names[0], rows, cols, IMAGE_INTERLEAVED);
+    cout = image_create(names[1], cols, rows, IMAGE_INTERLEAVED);
+    mout = image_create(names[2], rows, cols, IMAGE_INTERLEAVED);
+    if (in == NULL || cout == NULL || mout == NULL) {
+	printf("Can't create the stream image files\n");
+	exit(1);
+    }
+
+    for (r0 = 0; r0 < rows; r0 = r1) {
+	r1 = min(r0 + STREAM_BAND, rows);
+	p = image_map(in, r0, r1, &band);
+	for (n = 0; n < (long) (r1 - r0) * cols; n++) {
+	    p[n].red = random_in_interval(0, 65536);
+	    p[n].green = random_in_interval(0, 65536);
+	    p[n].blue = random_in_interval(0, 65536);
+	}
+	image_unmap(&band);
+    }
+
+    printf("Streaming %d x %d image in bands of %d rows:\n", rows, cols, STREAM_BAND);
+
+    start_counter();
+    stream_complex(in, cout, STREAM_BAND);
+    printf("Complex CPE\t%.1f\n", get_counter() / work);
+
+    start_counter();
+    stream_motion(in, mout, STREAM_BAND);
+    printf("Motion CPE\t%.1f\n", get_counter() / work);
+
+    if (check_stream_complex(in, cout) == 0 && check_stream_motion(in, mout) == 0)
+	printf("%d sampled pixels of each output are correct\n", STREAM_SAMPLES);
+
+    getrusage(RUSAGE_SELF, &usage);
+    printf("Peak resident memory %ld KB, image is %.0f KB\n\n",
+	   usage.ru_maxrss, work * sizeof(pixel) / 1024);
+
+    image_close(in);
+    image_close(cout);
+    image_close(mout);
+    if (!save_all_image_files)
+	for (k = 0; k < 3; k++)
+	    unlink(names[k]);
+}
+
+/*
+ * wall_seconds - Wall clock time in seconds, for rates over many
+ *     frames where cycle counts would include other threads' time
+ */
+static double wall_seconds(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/*
+ * test_batch_kind - One row of the batch table: frames/sec for nframes
+ *     dim x dim frames through one() a frame at a time, through
+ *     batch() in memory, and through batch() with the frames in image
+ *     files, first loading, computing and storing in turn and then
+ *     double buffered by batch_pipeline. Every output is checked
+ *     against one().
+ */
+static void test_batch_kind(int dim, int nframes, complex_test_func one,
+			    batch_func batch)
+{
+    pixel **src, **ref, **dst, *img;
+    char **in_names, **out_names;
+    batch_files files;
+    double t, rate[4];
+    int f, k, rows, cols, bad = 0;
+    size_t size = (size_t) dim * dim * sizeof(pixel);
+
+    src = malloc(nframes * sizeof(pixel *));
+    ref = malloc(nframes * sizeof(pixel *));
+    dst = malloc(nframes * sizeof(pixel *));
+    in_names = malloc(nframes * sizeof(char *));
+    out_names = malloc(nframes * sizeof(char *));
+    if (!src || !ref || !dst || !in_names || !out_names) {
+	fprintf(stderr, "Fatal error.  malloc failed in test_batch\n");
+	exit(1);
+    }
+    for (f = 0; f < nframes; f++) {
+	src[f] = malloc(size);
+	ref[f] = malloc(size);
+	dst[f] = malloc(size);
+	in_names[f] = malloc(32);
+	out_names[f] = malloc(32);
+	if (!src[f] || !ref[f] || !dst[f] || !in_names[f] || !out_names[f]) {
+	    fprintf(stderr, "Fatal error.  malloc failed in test_batch\n");
+	    exit(1);
+	}
+	for (k = 0; k < dim * dim; k++) {
+	    src[f][k].red = random_in_interval(0, 65536);
+	    src[f][k].green = random_in_interval(0, 65536);
+	    src[f][k].blue = random_in_interval(0, 65536);
+	}
+	sprintf(in_names[f], "batch_in_%d.img", f);
+	sprintf(out_names[f], "batch_out_%d.img", f);
+	if (image_write(in_names[f], dim, dim, src[f], IMAGE_INTERLEAVED) < 0) {
+	    printf("Can't write %s\n", in_names[f]);
+	    exit(1);
+	}
+    }
+    files.in = in_names;
+    files.out = out_names;
+
+    /* Warm up the pool and the caches */
+    batch(dim, src, dst, nframes);
+
+    t = wall_seconds();
+    for (f = 0; f < nframes; f++)
+	one(dim, src[f], ref[f]);
+    rate[0] = nframes / (wall_seconds() - t);
+
+    t = wall_seconds();
+    batch(dim, src, dst, nframes);
+    rate[1] = nframes / (wall_seconds() - t);
+    for (f = 0; f < nframes; f++)
+	bad |= memcmp(dst[f], ref[f], size) != 0;
+
+    t = wall_seconds();
+    for (f = 0; f < nframes; f++)
+	bad |= batch_load_file(&files, f, dim, src[f]) < 0;
+    batch(dim, src, dst, nframes);
+    for (f = 0; f < nframes; f++)
+	bad |= batch_store_file(&files, f, dim, dst[f]) < 0;
+    rate[2] = nframes / (wall_seconds() - t);
+
+    for (f = 0; f < nframes; f++)
+	unlink(out_names[f]);
+    t = wall_seconds();
+    bad |= batch_pipeline(batch, dim, nframes, pool_threads(),
+			  batch_load_file, batch_store_file, &files) < 0;
+    rate[3] = nframes / (wall_seconds() - t);
+    for (f = 0; f < nframes; f++) {
+	img = image_read(out_names[f], &rows, &cols);
+	bad |= img == NULL || rows != dim || cols != dim ||
+	    memcmp(img, ref[f], size) != 0;
+	free(img);
+    }
+
+    printf("%d\t%.1f\t\t%.1f\t%.1f\t\t%.1f\n", dim, rate[0], rate[1], rate[2], rate[3]);
+    if (bad)
+	printf("Batch output for dimension %d does not match one frame at a time.\n", dim);
+
+    for (f = 0; f < nframes; f++) {
+	if (!save_all_image_files) {
+	    unlink(in_names[f]);
+	    unlink(out_names[f]);
+	}
+	free(src[f]);
+	free(ref[f]);
+	free(dst[f]);
+	free(in_names[f]);
+	free(out_names[f]);
+    }
+    free(src);
+    free(ref);
+    free(dst);
+    free(in_names);
+    free(out_names);
+}
+
+/*
+ * test_batch - Report frames/sec of complex_batch and motion_batch
+ *     (see batch.h) over nframes frames at each test dimension
+ */
+static void test_batch(int nframes)
+{
+    int i;
+
+    printf("Complex: %d frames, %d threads, frames/sec:\n", nframes, pool_threads());
+    printf("Dim\tOne at a time\tBatch\tFiles, serial\tFiles, pipelined\n");
+    for (i = 0; i < DIM_CNT; i++)
+	test_batch_kind(test_dim_complex[i], nframes, complex, complex_batch);
+    printf("\n");
+
+    printf("Motion: %d frames, %d threads, frames/sec:\n", nframes, pool_threads());
+    printf("Dim\tOne at a time\tBatch\tFiles, serial\tFiles, pipelined\n");
+    for (i = 0; i < DIM_CNT; i++)
+	test_batch_kind(test_dim_motion[i], nframes, motion, motion_batch);
+    printf("\n");
+}
+
+void incremental_wrapper(void *arglist[])
+{
+    int dim = *((int *) arglist[0]);
+    pixel *prev = (pixel *) arglist[1];
+    pixel *cur = (pixel *) arglist[2];
+    pixel *out = (pixel *) arglist[3];
+    dirty_map *m = (dirty_map *) arglist[4];
+
+    dirty_diff(prev, cur, m);
+    motion_incremental(dim, cur, out, m);
+}
+
+/*
+ * test_incremental - Change percent % of the DIRTY_TILE tiles of a
+ *     frame and measure the CPE of bringing the motion output of the
+ *     unchanged frame up to date (diff pass included, see dirty.h)
+ *     next to the CPE of motion() on the whole frame
+ */
+static void test_incremental(int percent)
+{
+    int i, k, ti, tj, dim, tmpdim, ndirty;
+    double full, incr, prod = 1.0;
+    void *arglist[5];
+    dirty_map *m;
+    pixel *p;
+
+    printf("Motion with %d%% of the %dx%d tiles changed:\n", percent,
+	   DIRTY_TILE, DIRTY_TILE);
+    printf("Dim\tDirty\tFull CPE\tIncr CPE\tSpeedup\n");
+    for (i = 0; i < DIM_CNT; i++) {
+	dim = tmpdim = test_dim_motion[i];
+	full = measure_motion_funct(motion, dim);
+
+	/* tmp is the previous frame, orig the current one */
+	create(dim);
+	memcpy(tmp, orig, dim * dim * sizeof(pixel));
+	m = dirty_alloc(dim);
+	for (ti = 0; ti < m->tiles; ti++)
+	    for (tj = 0; tj < m->tiles; tj++)
+		if (random_in_interval(0, 100) < percent) {
+		    k = min(DIRTY_TILE, dim - ti * DIRTY_TILE);
+		    p = &orig[RIDX(ti * DIRTY_TILE + random_in_interval(0, k),
+				   tj * DIRTY_TILE, dim)];
+		    k = min(DIRTY_TILE, dim - tj * DIRTY_TILE);
+		    p[random_in_interval(0, k)].red ^= 0xffff;
+		}
+	motion(dim, tmp, result);
+
+	arglist[0] = (void *) &tmpdim;
+	arglist[1] = (void *) tmp;
+	arglist[2] = (void *) orig;
+	arglist[3] = (void *) result;
+	arglist[4] = (void *) m;
+	incr = fcyc_v((test_funct_v)&incremental_wrapper, arglist) / ((double) dim * dim);
+	ndirty = dirty_diff(tmp, orig, m);
+
+	motion(dim, orig, stage);
+	if (memcmp(result, stage, dim * dim * sizeof(pixel)) != 0) {
+	    printf("Incremental motion output for dimension %d does not match motion().\n", dim);
+	    dirty_free(m);
+	    return;
+	}
+	printf("%d\t%d/%d\t%.1f\t\t%.1f\t\t%.1f\n", dim, ndirty,
+	       m->tiles * m->tiles, full, incr, full / incr);
+	prod *= full / incr;
+	dirty_free(m);
+    }
+    printf("Mean speedup\t\t\t\t\t%.1f\n\n", pow(prod, 1.0 / DIM_CNT));
+}
+
+/*
+ * direct_box - The k x k box average the slow way, one window at a
+ *     time, with the edge windows cut off as in weighted_combo. The
+ *     reference for box_motion, and the O(k^2) cost it replaces.
+ */
+static void direct_box(int dim, pixel *src, pixel *dst, int k)
+{
+    int i, j, ii, jj, n;
+    long red, green, blue;
+
+    for (i = 0; i < dim; i++)
+	for (j = 0; j < dim; j++) {
+	    red = green = blue = n = 0;
+	    for (ii = i; ii < i + k && ii < dim; ii++)
+		for (jj = j; jj < j + k && jj < dim; jj++) {
+		    red += src[RIDX(ii, jj, dim)].red;
+		    green += src[RIDX(ii, jj, dim)].green;
+		    blue += src[RIDX(ii, jj, dim)].blue;
+		    n++;
+		}
+	    dst[RIDX(i, j, dim)].red = red / n;
+	    dst[RIDX(i, j, dim)].green = green / n;
+	    dst[RIDX(i, j, dim)].blue = blue / n;
+	}
+}
+
+void box_wrapper(void *arglist[]) 
+{
+    int dim = *((int *) arglist[0]);
+    int k = *((int *) arglist[3]);
+
+    box_motion(dim, (pixel *) arglist[1], (pixel *) arglist[2], k);
+}
+
+void direct_box_wrapper(void *arglist[]) 
+{
+    int dim = *((int *) arglist[0]);
+    int k = *((int *) arglist[3]);
+
+    direct_box(dim, (pixel *) arglist[1], (pixel *) arglist[2], k);
+}
+
+/*
+ * check_box - Check box_motion(k) on a fresh dim x dim image against
+ *     direct_box, leaving tmp with the reference output
+ */
+static int check_box(int dim, int k)
+{
+    int i;
+
+    create(dim);
+    box_motion(dim, orig, result, k);
+    if (check_orig(dim))
+	return 1;
+    direct_box(dim, orig, tmp, k);
+    for (i = 0; i < dim * dim; i++)
+	if (compare_pixels(result[i], tmp[i])) {
+	    printf("\nERROR: Dimension=%d, k=%d, %d errors\n", dim, k, 1);
+	    printf("You have dst[%d][%d] = (%d, %d, %d), it should be (%d, %d, %d)\n",
+		   i / dim, i % dim, result[i].red, result[i].green, result[i].blue,
+		   tmp[i].red, tmp[i].green, tmp[i].blue);
+	    return 1;
+	}
+    return 0;
+}
+
+/*
+ * test_box - Check box_motion (see sat.h) with a k x k window and
+ *     measure its CPE next to the CPE of averaging every window
+ *     directly
+ */
+static void test_box(int k)
+{
+    int i, dim, tmpdim;
+    double cpes[DIM_CNT], direct_cpes[DIM_CNT], prod = 1.0;
+    void *arglist[4];
+
+    for (i = 0; i < DIM_CNT; i++) {
+	dim = tmpdim = test_dim_motion[i];
+	if (check_box(ODD_DIM, k) || check_box(dim, k)) {
+	    printf("box_motion failed correctness check for k=%d.\n", k);
+	    return;
+	}
+
+	arglist[0] = (void *) &tmpdim;
+	arglist[1] = (void *) orig;
+	arglist[2] = (void *) result;
+	arglist[3] = (void *) &k;
+	cpes[i] = fcyc_v((test_funct_v)&box_wrapper, arglist) / ((double) dim * dim);
+	direct_cpes[i] = fcyc_v((test_funct_v)&direct_box_wrapper, arglist) /
+	    ((double) dim * dim);
+    }
+
+    printf("Box motion: %dx%d window, summed-area table:\n", k, k);
+    printf("Dim\t");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%d", test_dim_motion[i]);
+    printf("\tMean\n");
+
+    printf("Table CPEs");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%.1f", cpes[i]);
+    printf("\n");
+
+    printf("Direct CPEs");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%.1f", direct_cpes[i]);
+    printf("\n");
+
+    printf("Speedup\t");
+    for (i = 0; i < DIM_CNT; i++) {
+	prod *= direct_cpes[i] / cpes[i];
+	printf("\t%.1f", direct_cpes[i] / cpes[i]);
+    }
+    printf("\t%.1f\n\n", pow(prod, 1.0 / (double) DIM_CNT));
+}
+
+/*
+ * direct_conv - The weighted average of every k x k window the slow
+ *     way, with the weights that fall outside the image left out of
+ *     the sum, as in conv.h. The reference for the -G filters.
+ */
+static void direct_conv(int dim, pixel *src, pixel *dst, int k, const int *w)
+{
+    int i, j, ii, jj;
+    long red, green, blue, total, weight;
+
+    for (i = 0; i < dim; i++)
+	for (j = 0; j < dim; j++) {
+	    red = green = blue = total = 0;
+	    for (ii = i; ii < i + k && ii < dim; ii++)
+		for (jj = j; jj < j + k && jj < dim; jj++) {
+		    weight = w[(ii - i) * k + (jj - j)];
+		    red += weight * src[RIDX(ii, jj, dim)].red;
+		    green += weight * src[RIDX(ii, jj, dim)].green;
+		    blue += weight * src[RIDX(ii, jj, dim)].blue;
+		    total += weight;
+		}
+	    dst[RIDX(i, j, dim)].red = red / total;
+	    dst[RIDX(i, j, dim)].green = green / total;
+	    dst[RIDX(i, j, dim)].blue = blue / total;
+	}
+}
+
+static filter_t *direct_filter;
+
+void direct_conv_wrapper(void *arglist[]) 
+{
+    direct_conv(*((int *) arglist[0]), (pixel *) arglist[1],
+		(pixel *) arglist[2], direct_filter->k, direct_filter->w);
+}
+
+/*
+ * check_conv - Check filter f on a fresh dim x dim image against
+ *     direct_conv, leaving tmp with the reference output
+ */
+static int check_conv(filter_t *f, int dim)
+{
+    int i;
+
+    create(dim);
+    f->funct(dim, orig, result);
+    if (check_orig(dim))
+	return 1;
+    direct_conv(dim, orig, tmp, f->k, f->w);
+    for (i = 0; i < dim * dim; i++)
+	if (compare_pixels(result[i], tmp[i])) {
+	    printf("\nERROR: Dimension=%d, %d errors\n", dim, 1);
+	    printf("You have dst[%d][%d] = (%d, %d, %d), it should be (%d, %d, %d)\n",
+		   i / dim, i % dim, result[i].red, result[i].green, result[i].blue,
+		   tmp[i].red, tmp[i].green, tmp[i].blue);
+	    return 1;
+	}
+    return 0;
+}
+
+/*
+ * test_conv - Check filter f at every dim up to 2k + 1, where the
+ *     image is smaller than a window or has only a few full ones, at
+ *     ODD_DIM and at the test dims. Then measure its CPE next to the
+ *     CPE of direct_conv and the 3x3 box of motion (the first filter).
+ */
+static void test_conv(filter_t *f)
+{
+    int i, dim;
+    double cpes[DIM_CNT], direct_cpes[DIM_CNT], prod = 1.0;
+    void *arglist[3];
+
+    for (dim = 1; dim <= 2 * f->k + 1; dim++)
+	if (check_conv(f, dim)) {
+	    printf("Filter \"%s\" failed correctness check for dimension %d.\n",
+		   f->description, dim);
+	    return;
+	}
+
+    for (i = 0; i < DIM_CNT; i++) {
+	dim = test_dim_motion[i];
+	if (check_conv(f, ODD_DIM) || check_conv(f, dim)) {
+	    printf("Filter \"%s\" failed correctness check.\n", f->description);
+	    return;
+	}
+	cpes[i] = measure_motion_funct(f->funct, dim);
+
+	direct_filter = f;
+	arglist[0] = (void *) &dim;
+	arglist[1] = (void *) orig;
+	arglist[2] = (void *) result;
+	direct_cpes[i] = fcyc_v((test_funct_v)&direct_conv_wrapper, arglist) /
+	    ((double) dim * dim);
+    }
+
+    printf("Filter: %dx%d, %s:\n", f->k, f->k, f->description);
+    printf("Dim\t");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%d", test_dim_motion[i]);
+    printf("\tMean\n");
+
+    printf("Your CPEs");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%.1f", cpes[i]);
+    printf("\n");
+
+    if (f != &filters[0]) {
+	printf("Box3 CPEs");
+	for (i = 0; i < DIM_CNT; i++)
+	    printf("\t%.1f", filters[0].cpes[i]);
+	printf("\n");
+    }
+    for (i = 0; i < DIM_CNT; i++)
+	f->cpes[i] = cpes[i];
+
+    printf("Direct CPEs");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%.1f", direct_cpes[i]);
+    printf("\n");
+
+    printf("Speedup\t");
+    for (i = 0; i < DIM_CNT; i++) {
+	prod *= direct_cpes[i] / cpes[i];
+	printf("\t%.1f", direct_cpes[i] / cpes[i]);
+    }
+    printf("\t%.1f\n\n", pow(prod, 1.0 / (double) DIM_CNT));
+}
+
+/*
+ * Orientation check. The complex kernels only use the reorientation
+ * engine (see orient.h) as ORIENT_ANTI_TRANSPOSE with gray on, so -A
+ * checks all 8 orientations, gray and color, against a pixel by pixel
+ * version at odd and even dims around the 8x8 blocks and the 32x32
+ * leaves, at each ISA level it runs.
+ */
+static int orient_dims[] = {1, 2, 7, 8, 9, 31, 32, 33, 64, 65, ODD_DIM, 256, 257};
+#define ORIENT_DIM_CNT (sizeof(orient_dims)/sizeof(int))
+
+/* orient_index - Index of the dest pixel that src pixel (i,j) goes to */
+static int orient_index(int dim, orientation o, int i, int j)
+{
+    switch (o) {
+    case ORIENT_IDENTITY:       return RIDX(i, j, dim);
+    case ORIENT_ROT90:          return RIDX(j, dim-1-i, dim);
+    case ORIENT_ROT180:         return RIDX(dim-1-i, dim-1-j, dim);
+    case ORIENT_ROT270:         return RIDX(dim-1-j, i, dim);
+    case ORIENT_FLIP_H:         return RIDX(i, dim-1-j, dim);
+    case ORIENT_FLIP_V:         return RIDX(dim-1-i, j, dim);
+    case ORIENT_TRANSPOSE:      return RIDX(j, i, dim);
+    default:
+    case ORIENT_ANTI_TRANSPOSE: return RIDX(dim-1-j, dim-1-i, dim);
+    }
+}
+
+/*
+ * check_orient - Run reorient for every orientation, with and without
+ *     gray, at every orient_dims dim and check each dest pixel. Prints
+ *     the first bad pixel of each failing case and returns how many
+ *     cases failed.
+ */
+static int check_orient(void)
+{
+    int d, dim, o, gray, k, i, j, v, failed = 0;
+    pixel want, got;
+
+    for (d = 0; d < ORIENT_DIM_CNT; d++)
+	for (o = 0; o < ORIENT_COUNT; o++)
+	    for (gray = 0; gray <= 1; gray++) {
+		dim = orient_dims[d];
+		create(dim);
+		reorient(dim, orig, result, o, gray);
+		if (check_orig(dim)) {
+		    failed++;
+		    continue;
+		}
+		for (k = 0; k < dim * dim; k++) {
+		    i = k / dim;
+		    j = k % dim;
+		    want = orig[k];
+		    if (gray) {
+			v = ((int)want.red + (int)want.green + (int)want.blue) / 3;
+			want.red = want.green = want.blue = v;
+		    }
+		    got = result[orient_index(dim, o, i, j)];
+		    if (compare_pixels(got, want)) {
+			printf("reorient: orientation %d, gray %d, dimension %d: src[%d][%d] "
+			       "went to (%d, %d, %d), it should be (%d, %d, %d)\n",
+			       o, gray, dim, i, j, got.red, got.green, got.blue,
+			       want.red, want.green, want.blue);
+			failed++;
+			break;
+		    }
+		}
+	    }
+
+    if (failed)
+	printf("Orientation check: %d of %d cases failed\n\n", failed,
+	       (int) (ORIENT_DIM_CNT * ORIENT_COUNT * 2));
+    else
+	printf("Orientation check: %d orientations, gray and color, %d dims: OK\n\n",
+	       ORIENT_COUNT, (int) ORIENT_DIM_CNT);
+    return failed;
+}
+
+/*
+ * In-place mode. complex_inplace (see inplace.h) is checked and timed
+ * on a copy of orig in result, next to complex() out of place.
+ */
+void inplace_wrapper(void *arglist[]) 
+{
+    complex_inplace(*((int *) arglist[0]), (pixel *) arglist[1]);
+}
+
+/* check_inplace - Check complex_inplace on a fresh dim x dim image */
+static int check_inplace(int dim)
+{
+    create(dim);
+    memcpy(result, orig, dim * dim * sizeof(pixel));
+    complex_inplace(dim, result);
+    return check_complex(dim, 0);
+}
+
+/*
+ * check_inplace_dims - Check complex_inplace at dims 1..INPLACE_CHECK_DIM,
+ *     every residue mod 8 many times over and both sides of the 64x64
+ *     pool blocks, with the tile grid's left over columns and the
+ *     tiles paired with themselves on the anti-diagonal. Done at the
+ *     current ISA level and at scalar, with 1 pool thread and with 4.
+ */
+#define INPLACE_CHECK_DIM 136
+
+static int check_inplace_dims(void)
+{
+    int dim, l, t, bad = 0;
+    int levels[2] = { isa_current(), ISA_SCALAR }, threads[2] = { 1, 4 };
+    int saved_threads = pool_threads();
+
+    for (l = 0; l < 2 && !bad; l++)
+	for (t = 0; t < 2 && !bad; t++) {
+	    isa_force(levels[l]);
+	    pool_set_threads(threads[t]);
+	    for (dim = 1; dim <= INPLACE_CHECK_DIM && !bad; dim++)
+		if (check_inplace(dim)) {
+		    printf("complex_inplace failed correctness check for dimension %d at ISA level %s with %d threads.\n",
+			   dim, isa_name(levels[l]), threads[t]);
+		    bad = 1;
+		}
+	}
+
+    isa_force(levels[0]);
+    pool_set_threads(saved_threads);
+    return bad;
+}
+
+static void test_inplace(void)
+{
+    int i, dim, tmpdim;
+    double cpes[DIM_CNT], base_cpes[DIM_CNT], prod = 1.0;
+    void *arglist[2];
+
+    if (check_inplace_dims())
+	return;
+
+    for (i = 0; i < DIM_CNT; i++) {
+	dim = tmpdim = test_dim_complex[i];
+	if (check_inplace(ODD_DIM) || check_inplace(dim)) {
+	    printf("complex_inplace failed correctness check for dimension %d.\n", dim);
+	    return;
+	}
+
+	base_cpes[i] = measure_complex_funct(complex, dim);
+	arglist[0] = (void *) &tmpdim;
+	arglist[1] = (void *) result;
+	cpes[i] = fcyc_v((test_funct_v)&inplace_wrapper, arglist) / ((double) dim * dim);
+    }
+
+    printf("Complex in place:\n");
+    printf("Dim\t");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%d", test_dim_complex[i]);
+    printf("\tMean\n");
+
+    printf("In place CPEs");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%.1f", cpes[i]);
+    printf("\n");
+
+    printf("complex() CPEs");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%.1f", base_cpes[i]);
+    printf("\n");
+
+    printf("Speedup\t");
+    for (i = 0; i < DIM_CNT; i++) {
+	prod *= base_cpes[i] / cpes[i];
+	printf("\t%.2f", base_cpes[i] / cpes[i]);
+    }
+    printf("\t%.2f\n\n", pow(prod, 1.0 / (double) DIM_CNT));
+}
+
+/*
+ * Working-set sweep. Each kernel reads a dim x dim image and writes
+ * one, SWEEP_BYTES bytes per pixel of compulsory memory traffic, and
+ * is placed on a roofline in CPE terms. Its memory floor is the CPE
+ * at which that traffic moves at the bandwidth of wherever the working
+ * set lives: measured DRAM copy bandwidth once it is bigger than the
+ * last level cache, memcpy of the same image (from cache) below that.
+ * Its compute floor is the best CPE it reaches at any dim of the
+ * sweep, the fastest it has been seen to do its work when memory
+ * wasn't holding it back. The higher floor is the roof; the kernel is
+ * bound by whichever one that is.
+ */
+#define SWEEP_BYTES (2 * sizeof(pixel))
+#define SWEEP_DIMS 64
+
+void copy_wrapper(void *arglist[]) 
+{
+    int dim = *((int *) arglist[0]);
+
+    memcpy(arglist[2], arglist[1], (size_t) dim * dim * sizeof(pixel));
+}
+
+/* sweep_gbs - GB/s of moving SWEEP_BYTES per pixel at cpe cycles per
+   pixel, which is also the CPE of moving them at gbs GB/s */
+static double sweep_gbs(double cpe, double clock_mhz)
+{
+    return SWEEP_BYTES * clock_mhz / (cpe * 1000.0);
+}
+
+/* sweep_cache - Size of cache level (an _SC_LEVELn_CACHE_SIZE name),
+   or dflt if the system doesn't say */
+static long sweep_cache(int name, long dflt)
+{
+    long size = sysconf(name);
+
+    return (size > 0) ? size : dflt;
+}
+
+/*
+ * memory_gbs - Copy bandwidth out of DRAM: memcpy between two buffers
+ *     of 4x the last level cache each (at most 1 GB), best of 3
+ */
+static double memory_gbs(double clock_mhz, size_t *bytes)
+{
+    size_t n = 4 * (size_t) sweep_cache(_SC_LEVEL3_CACHE_SIZE, 64L << 20);
+    double cycles, best = 0.0;
+    char *a, *b;
+    int r;
+
+    if (n > (size_t) 1 << 30)
+	n = (size_t) 1 << 30;
+    a = malloc(n);
+    b = malloc(n);
+    if (a == NULL || b == NULL) {
+	fprintf(stderr, "Fatal error.  malloc failed in memory_gbs\n");
+	exit(1);
+    }
+    memset(a, 1, n);
+    memset(b, 2, n);
+    for (r = 0; r < 3; r++) {
+	start_counter();
+	memcpy(b, a, n);
+	cycles = get_counter();
+	if (best == 0.0 || cycles < best)
+	    best = cycles;
+    }
+    free(a);
+    free(b);
+
+    *bytes = n;
+    return 2.0 * n * clock_mhz / (best * 1000.0);
+}
+
+/*
+ * test_sweep - Run every selected complex and motion version over
+ *     dims from 16 up to MAX_DIM, about 12% apart, and print CPE,
+ *     GB/s, both floors and the bound at each one. Also writes it all
+ *     to csv_file, one line per kernel and dim, with the DRAM and peak
+ *     copy bandwidths on every line. A dim where the version fails its
+ *     check is marked wrong and left off the roofline.
+ */
+static void test_sweep(char *csv_file)
+{
+    int dims[SWEEP_DIMS], bad[SWEEP_DIMS], ndims = 0, d, i, b, k, tmpdim, good;
+    double clock_mhz, mem, peak = 0.0, gbs, roof[SWEEP_DIMS];
+    double cpes[SWEEP_DIMS], mem_cpe, comp_cpe, roof_cpe;
+    long ws, llc = sweep_cache(_SC_LEVEL3_CACHE_SIZE, 8L << 20);
+    size_t mem_bytes;
+    void *arglist[4];
+    FILE *csv;
+    bench_t *bench;
+
+    for (d = 16; d <= MAX_DIM && ndims < SWEEP_DIMS; d += d / 8 + 1)
+	dims[ndims++] = d;
+
+    if ((csv = fopen(csv_file, "w")) == NULL) {
+	printf("Can't open file %s\n", csv_file);
+	exit(-5);
+    }
+    fprintf(csv, "kernel,version,dim,working_set_bytes,cpe,gbs,copy_gbs,"
+	    "memory_gbs,peak_gbs,memory_roof_cpe,compute_roof_cpe,bound\n");
+
+    clock_mhz = mhz(0);
+    for (i = 0; i < ndims; i++) {
+	create(dims[i]);
+	tmpdim = dims[i];
+	arglist[0] = (void *) &tmpdim;
+	arglist[1] = (void *) orig;
+	arglist[2] = (void *) result;
+	roof[i] = sweep_gbs(fcyc_v((test_funct_v)&copy_wrapper, arglist) /
+			    ((double) dims[i] * dims[i]), clock_mhz);
+	if (roof[i] > peak)
+	    peak = roof[i];
+    }
+    mem = memory_gbs(clock_mhz, &mem_bytes);
+
+    printf("Clock %.0f MHz, LLC %ld KB\n", clock_mhz, llc >> 10);
+    printf("Copy bandwidth %.1f GB/s peak (in cache), %.1f GB/s from memory (%ld MB)\n\n",
+	   peak, mem, (long) (mem_bytes >> 20));
+
+    for (i = 0; i < ndims; i++)
+	fprintf(csv, "copy,memcpy,%d,%ld,%.2f,%.2f,%.2f,%.2f,%.2f,,,\n", dims[i],
+		(long) (dims[i] * dims[i] * SWEEP_BYTES),
+		sweep_gbs(roof[i], clock_mhz), roof[i], roof[i], mem, peak);
+
+    for (k = 0; k < 2; k++)
+	for (b = 0; b < (k ? motion_benchmark_count : complex_benchmark_count); b++) {
+	    bench = k ? &benchmarks_motion[b] : &benchmarks_complex[b];
+	    if (!bench->valid)
+		continue;
+
+	    /* Measure every dim first, the compute floor needs them all.
+	       Dims that fail their check don't count towards it. */
+	    comp_cpe = 0.0;
+	    good = 0;
+	    for (i = 0; i < ndims; i++) {
+		d = dims[i];
+		create(d);
+		if (k) {
+		    bench->motion_funct(d, orig, result);
+		    bad[i] = check_motion(d, 0);
+		    cpes[i] = measure_motion_funct(bench->motion_funct, d);
+		}
+		else {
+		    bench->complex_funct(d, orig, result);
+		    bad[i] = check_complex(d, 0);
+		    cpes[i] = measure_complex_funct(bench->complex_funct, d);
+		}
+		if (!bad[i] && (good++ == 0 || cpes[i] < comp_cpe))
+		    comp_cpe = cpes[i];
+	    }
+
+	    printf("%s: Version = %s:\n", k ? "Motion" : "Complex", bench->description);
+	    if (good)
+		printf("Compute floor %.1f CPE (best at any dim it passes)\n", comp_cpe);
+	    else
+		printf("No compute floor, the version fails its check at every dim\n");
+	    printf("Dim\tKB\tCPE\tGB/s\tMem CPE\tRoof CPE\t%% roof\tBound\n");
+	    for (i = 0; i < ndims; i++) {
+		d = dims[i];
+		ws = (long) (d * d * SWEEP_BYTES);
+		gbs = sweep_gbs(cpes[i], clock_mhz);
+		if (bad[i]) {
+		    /* Nothing to place on the roofline */
+		    printf("%d\t%ld\t%.1f\t%.1f\t\t\t\t\tWRONG OUTPUT\n", d,
+			   ws >> 10, cpes[i], gbs);
+		    fprintf(csv, "%s,\"%s\",%d,%ld,%.2f,%.2f,%.2f,%.2f,%.2f,,,wrong\n",
+			    k ? "motion" : "complex", bench->description, d, ws,
+			    cpes[i], gbs, roof[i], mem, peak);
+		    continue;
+		}
+		mem_cpe = sweep_gbs(ws > llc ? mem : roof[i], clock_mhz);
+		roof_cpe = (mem_cpe > comp_cpe) ? mem_cpe : comp_cpe;
+
+		printf("%d\t%ld\t%.1f\t%.1f\t%.1f\t%.1f\t\t%.0f\t%s\n", d,
+		       ws >> 10, cpes[i], gbs, mem_cpe, roof_cpe,
+		       100.0 * roof_cpe / cpes[i],
+		       mem_cpe > comp_cpe ? "bandwidth" : "compute");
+		fprintf(csv, "%s,\"%s\",%d,%ld,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%s\n",
+			k ? "motion" : "complex", bench->description, d, ws,
+			cpes[i], gbs, roof[i], mem, peak, mem_cpe, comp_cpe,
+			mem_cpe > comp_cpe ? "bandwidth" : "compute");
+	    }
+	    printf("\n");
+	}
+
+    fclose(csv);
+    printf("Wrote %s\n", csv_file);
+}
+
+/*
+ * test_large - Measure every selected complex version on images of
+ *     1024 x 1024 up to max_dim x max_dim, doubling, well past the
+ *     static test images and the caches. Each output is checked
+ *     against complex(), which the normal tests cover.
+ */
+static void test_large(int max_dim)
+{
+    int dims[16], ndims = 0, d, i, b, tmpdim;
+    double cpes[16];
+    size_t size, max_size;
+    pixel *src, *dst, *ref;
+    void *arglist[4];
+    char name[64];
+
+    for (d = 1024; d <= max_dim && ndims < 16; d *= 2)
+	dims[ndims++] = d;
+    max_size = (size_t) dims[ndims - 1] * dims[ndims - 1] * sizeof(pixel);
+    src = huge_alloc(max_size);
+    dst = huge_alloc(max_size);
+    ref = huge_alloc(max_size);
+
+    printf("Complex CPEs on large images:\n");
+    printf("Version\t\t");
+    for (i = 0; i < ndims; i++)
+	printf("\t%d", dims[i]);
+    printf("\n");
+
+    for (b = 0; b < complex_benchmark_count; b++) {
+	if (!benchmarks_complex[b].valid)
+	    continue;
+	for (i = 0; i < ndims; i++) {
+	    d = tmpdim = dims[i];
+	    size = (size_t) d * d * sizeof(pixel);
+	    for (tmpdim = 0; tmpdim < d * d; tmpdim++) {
+		src[tmpdim].red = random_in_interval(0, 65536);
+		src[tmpdim].green = random_in_interval(0, 65536);
+		src[tmpdim].blue = random_in_interval(0, 65536);
+	    }
+	    tmpdim = d;
+	    complex(d, src, ref);
+	    memset(dst, 0, size);
+	    benchmarks_complex[b].complex_funct(d, src, dst);
+	    if (memcmp(dst, ref, size) != 0) {
+		printf("Benchmark \"%s\" does not match complex() for dimension %d.\n",
+		       benchmarks_complex[b].description, d);
+		cpes[i] = 0.0;
+		continue;
+	    }
+
+	    arglist[0] = (void *) benchmarks_complex[b].complex_funct;
+	    arglist[1] = (void *) &tmpdim;
+	    arglist[2] = (void *) src;
+	    arglist[3] = (void *) dst;
+	    cpes[i] = fcyc_v((test_funct_v)&complex_wrapper, arglist) / ((double) d * d);
+	}
+
+	/* The function name is the description up to the colon */
+	sscanf(benchmarks_complex[b].description, "%63[^:]", name);
+	printf("%-23s", name);
+	for (i = 0; i < ndims; i++)
+	    printf("\t%.1f", cpes[i]);
+	printf("\n");
+    }
+    printf("\n");
+
+    huge_free(src, max_size);
+    huge_free(dst, max_size);
+    huge_free(ref, max_size);
+}
+
+/*
+ * Huge page mode. Every selected complex and motion version is timed
+ * with the image buffers on 4 KB pages, then again with them on 2 MB
+ * transparent huge pages (see hugepage.h).
+ */
+
+/* use_huge_pages - Reallocate the image buffers with huge pages on or off */
+static void use_huge_pages(int on)
+{
+    huge_set(on);
+    huge_free(data, DATA_SIZE);
+    data = NULL;
+}
+
+/* print_hugepage - Print the 4 KB and 2 MB page CPEs of one version */
+static void print_hugepage(char *kind, char *description, int *dims,
+			   double *small_cpes, double *huge_cpes)
+{
+    int i;
+    double prod = 1.0;
+
+    printf("%s: Version = %s:\n", kind, description);
+    printf("Dim\t");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%d", dims[i]);
+    printf("\tMean\n");
+
+    printf("4 KB CPEs");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%.1f", small_cpes[i]);
+    printf("\n");
+
+    printf("2 MB CPEs");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%.1f", huge_cpes[i]);
+    printf("\n");
+
+    printf("Speedup\t");
+    for (i = 0; i < DIM_CNT; i++) {
+	prod *= small_cpes[i] / huge_cpes[i];
+	printf("\t%.2f", small_cpes[i] / huge_cpes[i]);
+    }
+    printf("\t%.2f\n\n", pow(prod, 1.0 / (double) DIM_CNT));
+}
+
+/*
+ * test_hugepage - Time the selected versions on 4 KB and on 2 MB
+ *     pages, and report how much of the image buffers the kernel
+ *     actually put on huge pages each time
+ */
+static void test_hugepage(void)
+{
+    static double complex_cpes[2][MAX_BENCHMARKS][DIM_CNT];
+    static double motion_cpes[2][MAX_BENCHMARKS][DIM_CNT];
+    size_t backed[2];
+    int on, b, i;
+
+    for (on = 0; on < 2; on++) {
+	use_huge_pages(on);
+	for (b = 0; b < complex_benchmark_count; b++)
+	    if (benchmarks_complex[b].valid)
+		for (i = 0; i < DIM_CNT; i++)
+		    complex_cpes[on][b][i] = measure_complex(b, test_dim_complex[i]);
+	for (b = 0; b < motion_benchmark_count; b++)
+	    if (benchmarks_motion[b].valid)
+		for (i = 0; i < DIM_CNT; i++)
+		    motion_cpes[on][b][i] = measure_motion(b, test_dim_motion[i]);
+	create(test_dim_complex[DIM_CNT - 1]);
+	backed[on] = huge_backed(data, DATA_SIZE);
+    }
+
+    printf("Image buffers on huge pages: %zu MB with them off, %zu MB with them on\n\n",
+	   backed[0] >> 20, backed[1] >> 20);
+    if (backed[1] == 0)
+	printf("The kernel gave no huge pages (see "
+	       "/sys/kernel/mm/transparent_hugepage/enabled)\n\n");
+
+    for (b = 0; b < complex_benchmark_count; b++)
+	if (benchmarks_complex[b].valid)
+	    print_hugepage("Complex", benchmarks_complex[b].description,
+			   test_dim_complex, complex_cpes[0][b], complex_cpes[1][b]);
+    for (b = 0; b < motion_benchmark_count; b++)
+	if (benchmarks_motion[b].valid)
+	    print_hugepage("Motion", benchmarks_motion[b].description,
+			   test_dim_motion, motion_cpes[0][b], motion_cpes[1][b]);
+}
+
+/*
+ * Repeated measurement mode. Every selected version is measured reps
+ * times at each test dim, with the driver thread pinned to one CPU
+ * and the pool workers free to run on any, and summarized by its
+ * median, quartiles and the 95% confidence interval of the median (see
+ * stats.h). The samples can be saved to a baseline file and compared
+ * with an earlier one, version by version and dim by dim.
+ */
+#define REPEAT_DEFAULT 15
+#define REPEAT_RESULTS (2 * MAX_BENCHMARKS * DIM_CNT)
+
+static stats_result repeat_results[REPEAT_RESULTS];
+static stats_result baseline_results[REPEAT_RESULTS];
+
+typedef double (*measure_func)(int bench_index, int dim);
+
+/*
+ * repeat_version - Measure benchmark b of the given kind reps times at
+ *     each dim into r[0..DIM_CNT), print the summary and the comparison
+ *     with the baseline, and return the number of regressions. Adds
+ *     the comparisons with too few samples to decide to *too_few.
+ */
+static int repeat_version(char *title, char *kind, bench_t *bench, int b,
+			  measure_func measure, int *dims, int reps,
+			  stats_result *r, stats_result *baseline, int nbaseline,
+			  int *too_few)
+{
+    stats_summary sum[DIM_CNT], base[DIM_CNT];
+    stats_result *old[DIM_CNT];
+    stats_verdict verdict[DIM_CNT];
+    double p[DIM_CNT];
+    int i, k, slower = 0, compared = 0;
+
+    for (i = 0; i < DIM_CNT; i++) {
+	strncpy(r[i].kind, kind, sizeof(r[i].kind) - 1);
+	r[i].kind[sizeof(r[i].kind) - 1] = '\0';
+	strncpy(r[i].version, bench->description, sizeof(r[i].version) - 1);
+	r[i].version[sizeof(r[i].version) - 1] = '\0';
+	r[i].dim = dims[i];
+	r[i].n = reps;
+    }
+    /* Repetitions outermost, so slow drift is spread over every dim */
+    for (k = 0; k < reps; k++)
+	for (i = 0; i < DIM_CNT; i++)
+	    r[i].sample[k] = measure(b, dims[i]);
+
+    for (i = 0; i < DIM_CNT; i++) {
+	stats_summarize(r[i].sample, reps, &sum[i]);
+	old[i] = stats_find(baseline, nbaseline, kind, r[i].version, dims[i]);
+	if (old[i] != NULL) {
+	    stats_summarize(old[i]->sample, old[i]->n, &base[i]);
+	    verdict[i] = stats_compare(&r[i], old[i], &p[i]);
+	    compared++;
+	}
+    }
+
+    printf("%s: Version = %s:\n", title, bench->description);
+    printf("Dim\t");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%d", dims[i]);
+    printf("\n");
+
+    printf("Median CPE");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%.2f", sum[i].median);
+    printf("\n");
+
+    printf("IQR\t");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%.2f", sum[i].q3 - sum[i].q1);
+    printf("\n");
+
+    printf("95%% CI low");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%.2f", sum[i].ci_lo);
+    printf("\n");
+
+    printf("95%% CI high");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%.2f", sum[i].ci_hi);
+    printf("\n");
+
+    if (compared) {
+	printf("Baseline");
+	for (i = 0; i < DIM_CNT; i++)
+	    if (old[i] == NULL)
+		printf("\t-");
+	    else
+		printf("\t%.2f", base[i].median);
+	printf("\n");
+
+	printf("Change\t");
+	for (i = 0; i < DIM_CNT; i++)
+	    if (old[i] == NULL)
+		printf("\t-");
+	    else
+		printf("\t%+.1f%%", 100.0 * (sum[i].median / base[i].median - 1.0));
+	printf("\n");
+
+	printf("p-value\t");
+	for (i = 0; i < DIM_CNT; i++)
+	    if (old[i] == NULL)
+		printf("\t-");
+	    else
+		printf("\t%.3f", p[i]);
+	printf("\n");
+
+	printf("Verdict\t");
+	for (i = 0; i < DIM_CNT; i++) {
+	    if (old[i] == NULL)
+		printf("\tnew");
+	    else if (verdict[i] == STATS_SLOWER) {
+		printf("\tSLOWER");
+		slower++;
+	    }
+	    else if (verdict[i] == STATS_FASTER)
+		printf("\tfaster");
+	    else if (verdict[i] == STATS_TOO_FEW) {
+		printf("\ttoo few");
+		(*too_few)++;
+	    }
+	    else
+		printf("\tsame");
+	}
+	printf("\n");
+    }
+    printf("\n");
+    return slower;
+}
+
+/*
+ * check_stats - Check that stats_compare (see stats.h) calls two
+ *     clearly separated sets of STATS_MIN_SAMPLES CPEs slower and
+ *     faster, and that one sample fewer a side is too few to decide.
+ *     Returns the number of wrong verdicts.
+ */
+static int check_stats(void)
+{
+    static stats_result fast, slow;
+    int k, bad = 0;
+    double p;
+
+    for (k = 0; k < STATS_MIN_SAMPLES; k++) {
+	fast.sample[k] = 1.0 + 0.01 * k;
+	slow.sample[k] = 2.0 + 0.01 * k;
+    }
+    fast.n = slow.n = STATS_MIN_SAMPLES;
+    bad += stats_compare(&slow, &fast, &p) != STATS_SLOWER;
+    bad += stats_compare(&fast, &slow, &p) != STATS_FASTER;
+    fast.n = slow.n = STATS_MIN_SAMPLES - 1;
+    bad += stats_compare(&slow, &fast, &p) != STATS_TOO_FEW;
+
+    if (bad)
+	printf("Stats check: %d of 3 verdicts wrong for %d samples a side\n\n",
+	       bad, STATS_MIN_SAMPLES);
+    return bad;
+}
+
+/*
+ * test_repeat - Measure and summarize every selected version, save
+ *     the samples to save_file and compare them with baseline_file
+ *     (either may be NULL). Returns the number of regressions.
+ */
+static int test_repeat(int reps, char *save_file, char *baseline_file)
+{
+    int b, cpu, n = 0, nbaseline = 0, slower = 0, too_few = 0;
+
+    if (check_stats())
+	exit(1);
+
+    /* Pin the driver thread only; the pool workers keep every CPU */
+    pool_keep_affinity();
+    if ((cpu = stats_pin()) >= 0)
+	printf("Pinned to CPU %d, %d repetitions\n\n", cpu, reps);
+    else
+	printf("Could not pin to a CPU, %d repetitions\n\n", reps);
+
+    if (baseline_file != NULL) {
+	nbaseline = stats_load(baseline_file, baseline_results, REPEAT_RESULTS);
+	if (nbaseline < 0) {
+	    fprintf(stderr, "Can't open baseline file %s\n", baseline_file);
+	    exit(1);
+	}
+    }
+
+    for (b = 0; b < complex_benchmark_count; b++)
+	if (benchmarks_complex[b].valid) {
+	    slower += repeat_version("Complex", "complex", &benchmarks_complex[b], b,
+				     measure_complex, test_dim_complex, reps,
+				     &repeat_results[n], baseline_results, nbaseline,
+				     &too_few);
+	    n += DIM_CNT;
+	}
+    for (b = 0; b < motion_benchmark_count; b++)
+	if (benchmarks_motion[b].valid) {
+	    slower += repeat_version("Motion", "motion", &benchmarks_motion[b], b,
+				     measure_motion, test_dim_motion, reps,
+				     &repeat_results[n], baseline_results, nbaseline,
+				     &too_few);
+	    n += DIM_CNT;
+	}
+
+    if (save_file != NULL) {
+	if (stats_save(save_file, repeat_results, n) < 0) {
+	    fprintf(stderr, "Can't write baseline file %s\n", save_file);
+	    exit(1);
+	}
+	printf("Saved %d results to %s\n", n, save_file);
+    }
+    if (baseline_file != NULL) {
+	printf("%d significant regressions against %s (p < %.2f, change > %.0f%%)\n",
+	       slower, baseline_file, STATS_ALPHA, 100.0 * STATS_MIN_CHANGE);
+	if (too_few)
+	    printf("Warning: %d comparisons had too few samples to reach p < %.2f, "
+		   "it takes %d a side\n", too_few, STATS_ALPHA, STATS_MIN_SAMPLES);
+    }
+    return slower;
+}
+
+/*
+ * print_scaling - Print one block of the thread scaling table: the
+ *     CPEs measured with the given thread count, and the speedup over
+ *     the single thread CPEs
+ */
+static void print_scaling(int threads, double *cpes, double *base_cpes)
+{
+    int i;
+    double prod = 1.0;
+
+    printf("%d thread%s\t", threads, threads == 1 ? "" : "s");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%.1f", cpes[i]);
+    printf("\n");
+
+    printf("Speedup\t");
+    for (i = 0; i < DIM_CNT; i++) {
+	prod *= base_cpes[i]/cpes[i];
+	printf("\t%.2f", base_cpes[i]/cpes[i]);
+    }
+    printf("\t%.2f\n", pow(prod, 1.0/(double) DIM_CNT));
+}
+
+/*
+ * check_pool - Grow the pool (see pool.h) by one thread per job, from
+ *     2 threads up to max_threads, and check that every task of each
+ *     job has finished when pool_run_threads returns. A worker started
+ *     between two jobs must neither miss the next job nor count itself
+ *     done with it early.
+ */
+#define POOL_CHECK_TASKS 256
+
+static int pool_check_done[POOL_CHECK_TASKS];
+
+static void pool_check_task(void *arg, int task)
+{
+    volatile int spin;
+
+    for (spin = 0; spin < 2000; spin++)
+	;
+    __atomic_store_n(&pool_check_done[task], *(int *) arg, __ATOMIC_RELEASE);
+}
+
+static int check_pool(int max_threads)
+{
+    int threads, job, t, missing;
+
+    for (threads = 2, job = 1; threads <= max_threads; threads++, job++) {
+	pool_run_threads(pool_check_task, &job, POOL_CHECK_TASKS, threads);
+	for (t = 0, missing = 0; t < POOL_CHECK_TASKS; t++)
+	    if (__atomic_load_n(&pool_check_done[t], __ATOMIC_ACQUIRE) != job)
+		missing++;
+	if (missing) {
+	    printf("Pool check: %d of %d tasks unfinished when the job on %d threads returned\n\n",
+		   missing, POOL_CHECK_TASKS, threads);
+	    return 1;
+	}
+    }
+    printf("Pool check: grown to %d threads, every job finished on return: OK\n\n",
+	   max_threads);
+    return 0;
+}
+
+/*
+ * test_complex_threads - Measure complex benchmark bench_index with
+ *     1, 2, 4, ... max_threads pool threads (see pool.h), checking
+ *     correctness again at each thread count
+ */
+void test_complex_threads(int bench_index, int max_threads)
+{
+    int i, threads;
+    double cpes[DIM_CNT], base_cpes[DIM_CNT];
+
+    printf("Complex: Version = %s:\n", benchmarks_complex[bench_index].description);
+    printf("Dim\t");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%d", test_dim_complex[i]);
+    printf("\tMean\n");
+
+    for (threads = 1; ; threads = min(2*threads, max_threads)) {
+	pool_set_threads(threads);
+	for (i = 0; i < DIM_CNT; i++) {
+	    int dim = test_dim_complex[i];
+
+	    create(dim);
+	    run_complex_benchmark(bench_index, dim);
+	    if (check_complex(dim, 0)) {
+		printf("Benchmark \"%s\" failed correctness check for dimension %d with %d threads.\n",
+		       benchmarks_complex[bench_index].description, dim, threads);
+		return;
+	    }
+	    cpes[i] = measure_complex(bench_index, dim);
+	    if (threads == 1)
+		base_cpes[i] = cpes[i];
+	}
+	print_scaling(threads, cpes, base_cpes);
+	if (threads == max_threads)
+	    break;
+    }
+    printf("\n");
+}
+
+/*
+ * test_motion_threads - Measure motion benchmark bench_index with
+ *     1, 2, 4, ... max_threads pool threads (see pool.h), checking
+ *     correctness again at each thread count
+ */
+void test_motion_threads(int bench_index, int max_threads)
+{
+    int i, threads;
+    double cpes[DIM_CNT], base_cpes[DIM_CNT];
+
+    printf("Motion: Version = %s:\n", benchmarks_motion[bench_index].description);
+    printf("Dim\t");
+    for (i = 0; i < DIM_CNT; i++)
+	printf("\t%d", test_dim_motion[i]);
+    printf("\tMean\n");
+
+    for (threads = 1; ; threads = min(2*threads, max_threads)) {
+	pool_set_threads(threads);
+	for (i = 0; i < DIM_CNT; i++) {
+	    int dim = test_dim_motion[i];
+
+	    create(dim);
+	    run_motion_benchmark(bench_index, dim);
+	    if (check_motion(dim, 0)) {
+		printf("Benchmark \"%s\" failed correctness check for dimension %d with %d threads.\n",
+		       benchmarks_motion[bench_index].description, dim, threads);
+		return;
+	    }
+	    cpes[i] = measure_motion(bench_index, dim);
+	    if (threads == 1)
+		base_cpes[i] = cpes[i];
+	}
+	print_scaling(threads, cpes, base_cpes);
+	if (threads == max_threads)
+	    break;
+    }
+    printf("\n");
+}
+
+
+/* Candidates swept by tune mode (see tune.h) */
+static int tune_tiles[] = {0, 16, 32, 64, 128, 256};
+static int tune_bands[] = {4, 8, 16, 32, 64, 128};
+static int tune_unrolls[] = {1, 2, 4, 8};
+#define TUNE_TILE_CNT (sizeof(tune_tiles)/sizeof(int))
+#define TUNE_BAND_CNT (sizeof(tune_bands)/sizeof(int))
+#define TUNE_UNROLL_CNT (sizeof(tune_unrolls)/sizeof(int))
+
+/*
+ * tune_complex_dim - Time tuned_complex with every tile size and
+ *     1, 2, 4, ... pool_threads() threads on a dim x dim image, and
+ *     keep the fastest setting that passes the correctness check
+ */
+static void tune_complex_dim(int dim, double untuned_cpe)
+{
+    int i, threads, tiles, found = 0, max_threads = pool_threads();
+    complex_tune t, best = {0, 0, 0};
+    double cpe, best_cpe = 0.0;
+
+    for (i = 0; i < TUNE_TILE_CNT; i++) {
+	if (tune_tiles[i] >= dim)
+	    continue;
+	tiles = tune_tiles[i] ? (dim + tune_tiles[i] - 1) / tune_tiles[i] : 1;
+	for (threads = 1; ; threads = min(2*threads, max_threads)) {
+	    t.dim = dim;
+	    t.tile = tune_tiles[i];
+	    t.threads = threads;
+	    tune_set_complex(t);
+
+	    create(dim);
+	    tuned_complex(dim, orig, result);
+	    if (check_complex(dim, 0)) {
+		printf("tuned_complex failed correctness check for dimension %d with tile %d and %d threads.\n",
+		       dim, t.tile, threads);
+	    }
+	    else if ((cpe = measure_complex_funct(tuned_complex, dim)) < best_cpe ||
+		     !found) {
+		best_cpe = cpe;
+		best = t;
+		found = 1;
+	    }
+	    if (threads >= max_threads || threads >= tiles*tiles)
+		break;
+	}
+    }
+
+    if (!found) {
+	printf("No working complex setting for dimension %d\n", dim);
+	exit(1);
+    }
+    tune_set_complex(best);
+    printf("%d\t%d\t%d\t%.1f\t%.1f\n", dim, best.tile, best.threads,
+	   best_cpe, untuned_cpe);
+}
+
+/*
+ * tune_motion_dim - Time tuned_motion with every band height, both
+ *     loop structures, every unroll factor of the window helper loop
+ *     and 1, 2, 4, ... pool_threads() threads on a dim x dim image,
+ *     and keep the fastest working setting
+ */
+static void tune_motion_dim(int dim, double untuned_cpe)
+{
+    int i, u, rolling, threads, bands, found = 0, max_threads = pool_threads();
+    motion_tune t, best = {0, 0, 0, 0, 0};
+    double cpe, best_cpe = 0.0;
+
+    for (i = 0; i < TUNE_BAND_CNT; i++) {
+	if (tune_bands[i] > dim)
+	    continue;
+	bands = (dim + tune_bands[i] - 1) / tune_bands[i];
+	for (rolling = 0; rolling <= 1; rolling++)
+	    for (u = 0; u < (rolling ? 1 : TUNE_UNROLL_CNT); u++)
+		for (threads = 1; ; threads = min(2*threads, max_threads)) {
+		    t.dim = dim;
+		    t.band = tune_bands[i];
+		    t.threads = threads;
+		    t.rolling = rolling;
+		    t.unroll = tune_unrolls[u];
+		    tune_set_motion(t);
+
+		    create(dim);
+		    tuned_motion(dim, orig, result);
+		    if (check_motion(dim, 0)) {
+			printf("tuned_motion failed correctness check for dimension %d with band %d, rolling %d, unroll %d and %d threads.\n",
+			       dim, t.band, rolling, t.unroll, threads);
+		    }
+		    else if ((cpe = measure_motion_funct(tuned_motion, dim)) < best_cpe ||
+			     !found) {
+			best_cpe = cpe;
+			best = t;
+			found = 1;
+		    }
+		    if (threads >= max_threads || threads >= bands)
+			break;
+		}
+    }
+
+    if (!found) {
+	printf("No working motion setting for dimension %d\n", dim);
+	exit(1);
+    }
+    tune_set_motion(best);
+    printf("%d\t%d\t%d\t%d\t%d\t%.1f\t%.1f\n", dim, best.band, best.threads,
+	   best.rolling, best.unroll, best_cpe, untuned_cpe);
+}
+
+/*
+ * tune - Autotuner mode: pick the best tuned_complex and tuned_motion
+ *     settings for every test dimension and write them to tune_file.
+ *     Settings loaded at startup are ignored, so the untuned CPEs are
+ *     those of the built in defaults.
+ */
+static void tune(char *tune_file)
+{
+    int i;
+    double untuned[DIM_CNT];
+
+    tune_clear();
+    for (i = 0; i < DIM_CNT; i++)
+	untuned[i] = measure_complex_funct(tuned_complex, test_dim_complex[i]);
+    printf("Complex tuning (%d threads available):\n", pool_threads());
+    printf("Dim\tTile\tThreads\tCPE\tUntuned\n");
+    for (i = 0; i < DIM_CNT; i++)
+	tune_complex_dim(test_dim_complex[i], untuned[i]);
+    printf("\n");
+
+    for (i = 0; i < DIM_CNT; i++)
+	untuned[i] = measure_motion_funct(tuned_motion, test_dim_motion[i]);
+    printf("Motion tuning:\n");
+    printf("Dim\tBand\tThreads\tRolling\tUnroll\tCPE\tUntuned\n");
+    for (i = 0; i < DIM_CNT; i++)
+	tune_motion_dim(test_dim_motion[i], untuned[i]);
+    printf("\n");
+
+    /* The chosen settings, nearest entry lookups included, must also
+       work for a dimension that wasn't tuned */
+    create(ODD_DIM);
+    tuned_complex(ODD_DIM, orig, result);
+    if (check_complex(ODD_DIM, 0))
+	printf("Tuned complex failed correctness check for dimension %d.\n", ODD_DIM);
+    create(ODD_DIM);
+    tuned_motion(ODD_DIM, orig, result);
+    if (check_motion(ODD_DIM, 0))
+	printf("Tuned motion failed correctness check for dimension %d.\n", ODD_DIM);
+
+    if (tune_save(tune_file) < 0) {
+	printf("Can't write tuning file %s\n", tune_file);
+	exit(1);
+    }
+    printf("Wrote tuning file %s\n", tune_file);
+}
+
+
+void usage(char *progname) 
+{
+    fprintf(stderr, "Usage: %s [-hqgiIVCLFGOH8] [-f <func_file>] [-d <dump_file>] [-m <mode>]\n"
+                    "       [-P <n>] [-X <r>x<c>] [-B <n>] [-D <pct>] [-K <k>] [-W <file>]\n"
+                    "       [-N <dim>] [-R <n>] [-o <file>] [-b <file>] [-T <file>] [-A <isa>]\n",
+	    progname);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -h         Print this message\n");
+    fprintf(stderr, "  -i         Save test images as \".img\" files (see image.h)\n");
+    fprintf(stderr, "  -I         Save all images as \".img\" files\n");
+    fprintf(stderr, "  -m <mode>  Pick original image: gradient, squares, lines, or random\n");
+    fprintf(stderr, "  -q         Quit after dumping (use with -d )\n");
+    fprintf(stderr, "  -g         Autograder mode: checks only complex() and motion()\n");
+    fprintf(stderr, "  -f <file>  Get test function names from dump file <file>\n");
+    fprintf(stderr, "  -d <file>  Emit a dump file <file> for later use with -f\n");
+    fprintf(stderr, "  -V         Check results against cached golden hashes, tile by tile\n");
+    fprintf(stderr, "  -C         Also report IPC and cache, TLB and branch misses per pixel\n");
+    fprintf(stderr, "  -P <n>     Check the pool, then report CPE and speedup with 1, 2, 4, ... <n> threads\n");
+    fprintf(stderr, "  -L         Time the planar kernels with and without conversion\n");
+    fprintf(stderr, "  -8         Time the 8 bit channel kernels against the 16 bit ones\n");
+    fprintf(stderr, "  -F         Time the fused complex+motion kernels against complex() then motion()\n");
+    fprintf(stderr, "  -X <r>x<c> Stream complex and motion over an r x c image through files\n");
+    fprintf(stderr, "  -B <n>     Report frames/sec of the batch kernels over <n> frames\n");
+    fprintf(stderr, "  -D <pct>   Time incremental motion with <pct>%% of the tiles changed\n");
+    fprintf(stderr, "  -K <k>     Time the k x k box average against averaging each window\n");
+    fprintf(stderr, "  -G         Check and time the other filters of the convolution engine\n");
+    fprintf(stderr, "  -W <file>  Sweep dims 16..%d, place CPE and GB/s on a roofline, CSV to <file>\n", MAX_DIM);
+    fprintf(stderr, "  -N <dim>   Time the complex versions at 1024, 2048, ... up to <dim>\n");
+    fprintf(stderr, "  -R <n>     Report median, IQR and 95%% CI of the CPE over <n> >= %d runs\n",
+	    STATS_MIN_SAMPLES);
+    fprintf(stderr, "  -o <file>  Save the -R samples to the JSON baseline file <file>\n");
+    fprintf(stderr, "  -b <file>  Compare the -R samples with baseline <file>, exit 2 on a regression\n");
+    fprintf(stderr, "  -O         Time complex in place, with no dest image, against complex()\n");
+    fprintf(stderr, "  -H         Report CPE with the images on 4 KB pages and on 2 MB huge pages\n");
+    fprintf(stderr, "  -T <file>  Tune tiles, bands, unrolling and threads, save them to <file>\n");
+    fprintf(stderr, "  -A <isa>   Run the kernels at ISA level scalar, sse4.1, avx2 or avx512,\n"
+                    "             or at every level this CPU supports with \"all\",\n"
+                    "             each after checking all 8 orientations of orient.h\n");
+    exit(EXIT_FAILURE);
+}
+
+
+
+int main(int argc, char *argv[])
+{
+    int i;
+    int quit_after_dump = 0;
+    int skip_studentname_check = 0;
+    int autograder = 0;
+    char c = '0';
+    char *bench_func_file = NULL;
+    char *func_dump_file = NULL;
+    int max_threads = 0;
+    int planar = 0;
+    int fused = 0;
+    int filter_mode = 0;
+    int pixel8_mode = 0;
+    int stream_rows = 0, stream_cols = 0;
+    char *tune_file = NULL;
+    int isa = -1, isa_all = 0;
+    int batch_frames = 0;
+    int dirty_percent = -1;
+    int box_k = 0;
+    char *sweep_file = NULL;
+    int large_dim = 0;
+    int hugepage = 0;
+    int inplace = 0;
+    int reps = 0;
+    char *save_file = NULL, *baseline_file = NULL;
+
+    /* register all the defined functions */
+    register_complex_functions();
+    register_motion_functions();
+    register_planar_functions();
+    register_fused_functions();
+    register_pixel8_functions();
+    register_conv_functions();
+
+    /* parse command line args */
+    while ((c = getopt(argc, argv, "iIm:tgqf:d:s:P:CL8FGHVOT:X:A:B:D:K:W:N:R:o:b:h")) != -1)
+	switch (c) {
+
+        case 'i':
+          save_test_image_files = 1;
+          break;
+
+        case 'I':
+          save_all_image_files = 1;
+          break;
+
+        case 'm':
+          if (!strcmp(optarg, "gradient")) {
+            image_mode = GRADIENT;
+          } else if (!strcmp(optarg, "squares")) {
+            image_mode = SQUARES;
+          } else if (!strcmp(optarg, "lines")) {
+            image_mode = LINES;
+          } else if (!strcmp(optarg, "random")) {
+            image_mode = RANDOM;
+          } else {
+            fprintf(stderr, "unrecognized image mode: %s\n", optarg);
+            exit(1);
+          }
+          break;
+	  
+	case 't': /* skip student name check (hidden flag) */
+	    skip_studentname_check = 1;
+	    break;
+
+	case 's': /* seed for random number generator (hidden flag) */
+	    seed = atoi(optarg);
+	    break;
+
+	case 'g': /* autograder mode (checks only complex() and motion()) */
+	    autograder = 1;
+	    break;
+
+	case 'q':
+	    quit_after_dump = 1;
+	    break;
+
+	case 'C': /* hardware counters */
+	    counters = 1;
+	    break;
+
+	case 'L': /* planar mode */
+	    planar = 1;
+	    break;
+
+	case '8': /* 8 bit channel mode */
+	    pixel8_mode = 1;
+	    break;
+
+	case 'F': /* fused mode */
+	    fused = 1;
+	    break;
+
+	case 'G': /* filter mode */
+	    filter_mode = 1;
+	    break;
+
+	case 'X': /* streaming mode */
+	    if (sscanf(optarg, "%dx%d", &stream_rows, &stream_cols) != 2 ||
+		stream_rows < 1 || stream_cols < 1) {
+		fprintf(stderr, "image size must look like <rows>x<cols>\n");
+		exit(1);
+	    }
+	    break;
+
+	case 'A': /* ISA level (see isa.h) */
+	    if (!strcmp(optarg, "all"))
+		isa_all = 1;
+	    else if ((isa = isa_lookup(optarg)) < 0) {
+		fprintf(stderr, "unrecognized ISA level: %s\n", optarg);
+		exit(1);
+	    }
+	    else if (isa_force(isa) < 0) {
+		fprintf(stderr, "this CPU does not support %s\n", optarg);
+		exit(1);
+	    }
+	    break;
+
+	case 'B': /* batch mode */
+	    batch_frames = atoi(optarg);
+	    if (batch_frames < 1) {
+		fprintf(stderr, "frame count must be at least 1\n");
+		exit(1);
+	    }
+	    break;
+
+	case 'D': /* incremental motion mode */
+	    dirty_percent = atoi(optarg);
+	    if (dirty_percent < 0 || dirty_percent > 100) {
+		fprintf(stderr, "percent of changed tiles must be between 0 and 100\n");
+		exit(1);
+	    }
+	    break;
+
+	case 'K': /* box motion mode */
+	    box_k = atoi(optarg);
+	    if (box_k < 1 || box_k > SAT_MAX_K) {
+		fprintf(stderr, "box size must be between 1 and %d\n", SAT_MAX_K);
+		exit(1);
+	    }
+	    break;
+
+	case 'W': /* working-set sweep mode */
+	    sweep_file = strdup(optarg);
+	    break;
+
+	case 'R': /* repeated measurement mode */
+	    reps = atoi(optarg);
+	    if (reps < STATS_MIN_SAMPLES || reps > STATS_MAX_SAMPLES) {
+		fprintf(stderr, "repetitions must be between %d and %d\n",
+			STATS_MIN_SAMPLES, STATS_MAX_SAMPLES);
+		exit(1);
+	    }
+	    break;
+
+	case 'o': /* save a baseline file (implies -R) */
+	    save_file = strdup(optarg);
+	    break;
+
+	case 'b': /* compare with a baseline file (implies -R) */
+	    baseline_file = strdup(optarg);
+	    break;
+
+	case 'V': /* golden hash checks */
+	    golden_checks = 1;
+	    break;
+
+	case 'O': /* in-place mode */
+	    inplace = 1;
+	    break;
+
+	case 'H': /* huge page mode */
+	    hugepage = 1;
+	    break;
+
+	case 'N': /* large image mode */
+	    large_dim = atoi(optarg);
+	    if (large_dim < 1024) {
+		fprintf(stderr, "large image dim must be at least 1024\n");
+		exit(1);
+	    }
+	    break;
+
+	case 'T': /* autotuner mode */
+	    tune_file = strdup(optarg);
+	    break;
+
+	case 'P': /* thread scaling mode */
+	    max_threads = atoi(optarg);
+	    if (max_threads < 1 || max_threads > POOL_MAX_THREADS) {
+		fprintf(stderr, "thread count must be between 1 and %d\n", POOL_MAX_THREADS);
+		exit(1);
+	    }
+	    break;
 
 	case 'f': /* get names of benchmark functions from this file */
 	    bench_func_file = strdup(optarg);
@@ -894,9 +3495,182 @@ int main(int argc, char *argv[])
     /* Set measurement (fcyc) parameters */
     set_fcyc_cache_size(1 << 14); /* 16 KB cache size */
     set_fcyc_clear_cache(1); /* clear the cache before each measurement */
-#ifdef __linux__
-    set_fcyc_compensate(1); /* try to compensate for timer overhead */
-#endif
+    /*
+     * No timer interrupt compensation. times() counts the user ticks
+     * of every pool thread, and each tick takes a whole calibrated
+     * tick of cycles off the sample, so the parallel kernels (and any
+     * fast kernel that crosses a tick) came out low or even negative.
+     */
+    set_fcyc_compensate(0);
+    if (counters && set_fcyc_counters(1) == 0) {
+	printf("Hardware counters unavailable (see /proc/sys/kernel/perf_event_paranoid),\n"
+	       "reporting cycles only\n\n");
+	counters = 0;
+    }
+
+    /*
+     * In autotuner mode, only tuned_complex and tuned_motion are
+     * measured, over their candidate settings
+     */
+    if (tune_file != NULL) {
+	tune(tune_file);
+	return 0;
+    }
+
+    /*
+     * In streaming mode, only the streaming kernels are run
+     */
+    if (stream_rows) {
+	test_stream(stream_rows, stream_cols);
+	return 0;
+    }
+
+    /*
+     * In large image mode, only complex is measured, on huge_alloc'd images
+     */
+    if (large_dim) {
+	test_large(large_dim);
+	return 0;
+    }
+
+    /*
+     * In repeated measurement mode, every selected version is measured
+     * reps times; the exit status is 2 if any got significantly slower
+     * than the baseline
+     */
+    if (reps || save_file != NULL || baseline_file != NULL) {
+	if (test_repeat(reps ? reps : REPEAT_DEFAULT, save_file, baseline_file))
+	    return 2;
+	return 0;
+    }
+
+    /*
+     * In in-place mode, only complex_inplace is measured
+     */
+    if (inplace) {
+	test_inplace();
+	return 0;
+    }
+
+    /*
+     * In huge page mode, every selected version is run with the image
+     * buffers on 4 KB and then on 2 MB pages
+     */
+    if (hugepage) {
+	test_hugepage();
+	return 0;
+    }
+
+    /*
+     * In sweep mode, every selected version is run over the dim sweep
+     */
+    if (sweep_file != NULL) {
+	test_sweep(sweep_file);
+	return 0;
+    }
+
+    /*
+     * In filter mode, only the convolution engine filters are measured
+     */
+    if (filter_mode) {
+	for (i = 0; i < filter_count; i++)
+	    test_conv(&filters[i]);
+	return 0;
+    }
+
+    /*
+     * In box motion mode, only box_motion is measured
+     */
+    if (box_k) {
+	test_box(box_k);
+	return 0;
+    }
+
+    /*
+     * In incremental mode, only motion_incremental is measured
+     */
+    if (dirty_percent >= 0) {
+	test_incremental(dirty_percent);
+	return 0;
+    }
+
+    /*
+     * In batch mode, only the batch kernels are run
+     */
+    if (batch_frames) {
+	test_batch(batch_frames);
+	return 0;
+    }
+
+    /*
+     * In 8 bit mode, only the pixel8 kernels are measured
+     */
+    if (pixel8_mode) {
+	for (i = 0; i < pixel8_complex_benchmark_count; i++)
+	    test_pixel8_complex(i);
+	for (i = 0; i < pixel8_motion_benchmark_count; i++)
+	    test_pixel8_motion(i);
+	return 0;
+    }
+
+    /*
+     * In fused mode, only the fused kernels are measured
+     */
+    if (fused) {
+	for (i = 0; i < fused_benchmark_count; i++)
+	    test_fused(i);
+	return 0;
+    }
+
+    /*
+     * In planar mode, only the planar kernels are measured
+     */
+    if (planar) {
+	for (i = 0; i < planar_complex_benchmark_count; i++)
+	    test_planar_complex(i);
+	for (i = 0; i < planar_motion_benchmark_count; i++)
+	    test_planar_motion(i);
+	return 0;
+    }
+
+    /*
+     * In ISA mode, measure every version at each ISA level this CPU
+     * supports, from scalar up
+     */
+    if (isa_all) {
+	for (isa = ISA_SCALAR; isa <= isa_detect(); isa++) {
+	    isa_force(isa);
+	    printf("ISA level: %s\n\n", isa_name(isa));
+	    check_orient();
+	    for (i = 0; i < complex_benchmark_count; i++)
+		if (benchmarks_complex[i].valid)
+		    test_complex(i);
+	    for (i = 0; i < motion_benchmark_count; i++)
+		if (benchmarks_motion[i].valid)
+		    test_motion(i);
+	}
+	return 0;
+    }
+    if (isa >= 0) {
+	printf("ISA level: %s\n\n", isa_name(isa));
+	check_orient();
+    }
+
+    /* 
+     * In thread scaling mode, measure every version at each thread
+     * count instead of against the baseline CPEs
+     */
+    if (max_threads) {
+	if (max_threads > 1 && check_pool(max_threads))
+	    return 1;
+	for (i = 0; i < complex_benchmark_count; i++)
+	    if (benchmarks_complex[i].valid)
+		test_complex_threads(i, max_threads);
+	for (i = 0; i < motion_benchmark_count; i++)
+	    if (benchmarks_motion[i].valid)
+		test_motion_threads(i, max_threads);
+	return 0;
+    }
 
     for (i = 0; i < complex_benchmark_count; i++) {
 	if (benchmarks_complex[i].valid)
@@ -5,6 +5,7 @@
 
 #include "clock.h"
 #include "fcyc.h"
+#include "perfctr.h"
 
 #define K 3
 #define MAXSAMPLES 20
@@ -21,6 +22,10 @@ static int maxsamples = MAXSAMPLES;
 static double epsilon = EPSILON;
 static int cache_bytes = CACHE_BYTES;
 static int cache_block = CACHE_BLOCK;
+static int counters = 0;
+
+/* Counter values of the fastest sample of the last measurement */
+static perf_sample best_counts;
 
 static int *cache_buf = NULL;
 
@@ -107,6 +112,16 @@ static void clear()
   sink = x;
 }
 
+/* Read the counters, keep them if cyc is the fastest sample so far */
+static void keep_counts(double cyc)
+{
+  perf_sample sample;
+
+  perf_stop(&sample);
+  if (samplecount == 0 || cyc < values[0])
+    best_counts = sample;
+}
+
 double fcyc(test_funct f, int *params)
 {
   double result;
@@ -116,9 +131,13 @@ double fcyc(test_funct f, int *params)
       double cyc;
       if (clear_cache)
 	clear();
+      if (counters)
+	perf_start();
       start_comp_counter();
       f(params);
       cyc = get_comp_counter();
+      if (counters)
+	keep_counts(cyc);
       add_sample(cyc);
     } while (!has_converged() && samplecount < maxsamples);
   } else {
@@ -126,9 +145,13 @@ double fcyc(test_funct f, int *params)
       double cyc;
       if (clear_cache)
 	clear();
+      if (counters)
+	perf_start();
       start_counter();
       f(params);
       cyc = get_counter();
+      if (counters)
+	keep_counts(cyc);
       add_sample(cyc);
     } while (!has_converged() && samplecount < maxsamples);
   }
@@ -162,9 +185,13 @@ double fcyc_v(test_funct_v f, void *params[])
       double cyc;
       if (clear_cache)
 	clear();
+      if (counters)
+	perf_start();
       start_comp_counter();
       f(params);
       cyc = get_comp_counter();
+      if (counters)
+	keep_counts(cyc);
       add_sample(cyc);
     } while (!has_converged() && samplecount < maxsamples);
   } else {
@@ -172,9 +199,13 @@ double fcyc_v(test_funct_v f, void *params[])
       double cyc;
       if (clear_cache)
 	clear();
+      if (counters)
+	perf_start();
       start_counter();
       f(params);
       cyc = get_counter();
+      if (counters)
+	keep_counts(cyc);
       add_sample(cyc);
     } while (!has_converged() && samplecount < maxsamples);
   }
@@ -264,7 +295,25 @@ void set_fcyc_epsilon(double epsilon_arg)
   epsilon = epsilon_arg;
 }
 
+/* When set, will read the hardware counters (see perfctr.h) around
+   each sample, if perf_event_open allows any. Returns the number of
+   counters that could be opened.
+   Default = 0
+*/
+int set_fcyc_counters(int on)
+{
+  int n = 0;
+
+  if (on)
+    n = perf_open();
+  if (n == 0)
+    perf_close();
+  counters = (n > 0);
+  return n;
+}
 
-
-
-
+/* Counters of the sample the last fcyc/fcyc_v call returned */
+void fcyc_counters(perf_sample *s)
+{
+  *s = best_counts;
+}
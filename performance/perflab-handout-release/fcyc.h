@@ -1,3 +1,4 @@
+#include "perfctr.h"
 
 /* Fcyc measures the speed of any "test function."  Such a function
    is passed a list of integer parameters, which it may interpret
@@ -51,5 +52,12 @@ void set_fcyc_maxsamples(int maxsamples);
 */
 void set_fcyc_epsilon(double epsilon);
 
+/* When set, will read the hardware counters (see perfctr.h) around
+   each sample. Returns the number of hardware counters perf_event_open
+   allows; with 0, counters stay off and only cycles are measured.
+   Default = 0
+*/
+int set_fcyc_counters(int on);
 
-
+/* Counters of the sample returned by the last fcyc or fcyc_v call */
+void fcyc_counters(perf_sample *s);
@@ -0,0 +1,17 @@
+/*
+ * fused.h - Fused complex + motion kernels for the Performance Lab.
+ *
+ * A fused kernel computes motion(complex(src)) in a single pass, so
+ * the intermediate image never goes out to memory. They have the same
+ * signature as complex and motion, and are timed with "driver -F"
+ * against running complex() and then motion().
+ */
+#ifndef _FUSED_H_
+#define _FUSED_H_
+
+#include "defs.h"
+
+void register_fused_functions(void);
+void add_fused_function(complex_test_func, char*);
+
+#endif /* _FUSED_H_ */
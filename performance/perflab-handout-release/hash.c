@@ -0,0 +1,79 @@
+/* Image hashes, see hash.h */
+#include <string.h>
+
+#include "defs.h"
+#include "hash.h"
+#include "pool.h"
+
+#define HASH_MUL 0x9e3779b97f4a7c15ULL
+
+/* Final avalanche of a 64 bit hash (MurmurHash3's fmix64) */
+static uint64_t mix(uint64_t h)
+{
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+/* Fold the n bytes at p into h, 8 at a time */
+static uint64_t hash_bytes(uint64_t h, const unsigned char *p, size_t n)
+{
+  uint64_t w;
+
+  for (; n >= 8; p += 8, n -= 8) {
+    memcpy(&w, p, 8);
+    h = (h ^ w) * HASH_MUL;
+    h ^= h >> 29;
+  }
+  if (n > 0) {
+    w = 0;
+    memcpy(&w, p, n);
+    h = (h ^ w) * HASH_MUL;
+    h ^= h >> 29;
+  }
+  return h;
+}
+
+typedef struct {
+  int dim;
+  pixel *img;
+  uint64_t *tiles;
+} hash_args;
+
+static void hash_task(void *vargs, int ti)
+{
+  hash_args *a = (hash_args *)vargs;
+  int dim = a->dim, tiles = HASH_TILES(dim);
+  int i, tj, j0, n;
+  int i1 = (ti + 1) * HASH_TILE < dim ? (ti + 1) * HASH_TILE : dim;
+  uint64_t *row = &a->tiles[ti * tiles];
+
+  // Each tile starts from its own index, so equal tiles in different
+  // places don't hash alike
+  for (tj = 0; tj < tiles; tj++)
+    row[tj] = (uint64_t)(ti * tiles + tj + 1) * HASH_MUL;
+
+  for (i = ti * HASH_TILE; i < i1; i++)
+    for (tj = 0; tj < tiles; tj++) {
+      j0 = tj * HASH_TILE;
+      n = (j0 + HASH_TILE < dim) ? HASH_TILE : dim - j0;
+      row[tj] = hash_bytes(row[tj], (unsigned char *)&a->img[RIDX(i, j0, dim)],
+                           n * sizeof(pixel));
+    }
+
+  for (tj = 0; tj < tiles; tj++)
+    row[tj] = mix(row[tj]);
+}
+
+uint64_t hash_image(int dim, pixel *img, uint64_t *tiles)
+{
+  hash_args args = { dim, img, tiles };
+  int n = HASH_TILES(dim);
+
+  pool_run(hash_task, &args, n);
+  return mix(hash_bytes((uint64_t)dim, (unsigned char *)tiles,
+                        (size_t)n * n * sizeof(uint64_t)));
+}
@@ -0,0 +1,27 @@
+/*
+ * hash.h - 64 bit hashes of images, whole and by tile, for the
+ * Performance Lab.
+ *
+ * An image is split into HASH_TILE x HASH_TILE tiles (smaller at the
+ * bottom and right edges), each tile is hashed on its own, and the
+ * image hash is the hash of the tile hashes. The tiles are hashed on
+ * the worker pool (see pool.h), one row of tiles per task. The hash is
+ * for comparing images, not for security.
+ */
+#ifndef _HASH_H_
+#define _HASH_H_
+
+#include <stdint.h>
+
+#include "defs.h"
+
+#define HASH_TILE 32
+
+/* Tiles per side of a dim x dim image */
+#define HASH_TILES(dim) (((dim) + HASH_TILE - 1) / HASH_TILE)
+
+/* Hash img, and put the hash of tile (ti,tj) in tiles[ti *
+   HASH_TILES(dim) + tj] */
+uint64_t hash_image(int dim, pixel *img, uint64_t *tiles);
+
+#endif /* _HASH_H_ */
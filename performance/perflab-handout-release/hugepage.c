@@ -0,0 +1,83 @@
+/* Huge page image buffers, see hugepage.h */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include "hugepage.h"
+
+static int enabled = -1;  /* -1 = PERFLAB_HUGE not read yet */
+
+void huge_set(int on)
+{
+  enabled = on != 0;
+}
+
+int huge_enabled(void)
+{
+  char *env;
+
+  if (enabled < 0) {
+    env = getenv("PERFLAB_HUGE");
+    enabled = (env == NULL || atoi(env) != 0);
+  }
+  return enabled;
+}
+
+static size_t round_up(size_t size)
+{
+  return (size + HUGE_PAGE - 1) & ~(size_t)(HUGE_PAGE - 1);
+}
+
+void *huge_alloc(size_t size)
+{
+  size_t len = round_up(size > 0 ? size : 1);
+  char *map, *p;
+
+  // Map one huge page extra and trim the ends to a HUGE_PAGE boundary
+  map = mmap(NULL, len + HUGE_PAGE, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Fatal error.  mmap failed in huge_alloc\n");
+    exit(1);
+  }
+  p = (char *)round_up((uintptr_t)map);
+  if (p > map)
+    munmap(map, p - map);
+  if (map + HUGE_PAGE > p)
+    munmap(p + len, map + HUGE_PAGE - p);
+
+#ifdef MADV_HUGEPAGE
+  madvise(p, len, huge_enabled() ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+#endif
+  return p;
+}
+
+void huge_free(void *p, size_t size)
+{
+  if (p != NULL)
+    munmap(p, round_up(size > 0 ? size : 1));
+}
+
+size_t huge_backed(void *p, size_t size)
+{
+  uintptr_t lo = (uintptr_t)p, hi = lo + size, start = 0, end = 0;
+  unsigned long s, e;
+  size_t kb, total = 0;
+  char line[256];
+  FILE *f = fopen("/proc/self/smaps", "r");
+
+  if (f == NULL)
+    return 0;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (sscanf(line, "%lx-%lx ", &s, &e) == 2) {
+      start = s;
+      end = e;
+    }
+    else if (sscanf(line, "AnonHugePages: %zu kB", &kb) == 1 &&
+             start < hi && end > lo)
+      total += kb * 1024;
+  }
+  fclose(f);
+  return total < size ? total : size;
+}
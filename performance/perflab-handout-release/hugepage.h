@@ -0,0 +1,34 @@
+/*
+ * hugepage.h - Image buffers on 2 MB transparent huge pages for the
+ * Performance Lab.
+ *
+ * complex writes down the columns of its destination, so at dim 1024
+ * (6 KB rows) every output row of a tile is on a different 4 KB page
+ * and the data TLB can't hold the pages of one tile. A 2 MB page holds
+ * over 300 rows. huge_alloc maps anonymous memory on a HUGE_PAGE
+ * boundary and asks for huge pages with madvise(MADV_HUGEPAGE). With
+ * huge pages turned off (huge_set(0), or PERFLAB_HUGE=0 in the
+ * environment) it asks for normal pages with MADV_NOHUGEPAGE instead,
+ * so the two can be compared even where the kernel's THP setting is
+ * "always".
+ */
+#ifndef _HUGEPAGE_H_
+#define _HUGEPAGE_H_
+
+#include <stddef.h>
+
+#define HUGE_PAGE (2L << 20)
+
+/* size bytes, HUGE_PAGE aligned and zero filled. Exits on failure. */
+void *huge_alloc(size_t size);
+void huge_free(void *p, size_t size);
+
+/* Turn huge pages on or off for later huge_allocs (default on) */
+void huge_set(int on);
+int huge_enabled(void);
+
+/* Bytes of [p, p + size) the kernel has put on huge pages, from
+   /proc/self/smaps. 0 if none or if that can't be read. */
+size_t huge_backed(void *p, size_t size);
+
+#endif /* _HUGEPAGE_H_ */
@@ -0,0 +1,203 @@
+/* Binary image files, see image.h */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "defs.h"
+#include "image.h"
+
+/* Bytes of pixel data in a rows x cols file */
+static off_t data_size(int rows, int cols)
+{
+  return (off_t)rows * cols * sizeof(pixel);
+}
+
+static image_file *new_image_file(int fd, int rows, int cols, int layout,
+                                  int writable)
+{
+  image_file *f;
+
+  if ((f = malloc(sizeof(image_file))) == NULL) {
+    fprintf(stderr, "Fatal error.  malloc failed in new_image_file\n");
+    exit(1);
+  }
+  f->fd = fd;
+  f->rows = rows;
+  f->cols = cols;
+  f->layout = layout;
+  f->writable = writable;
+  return f;
+}
+
+image_file *image_create(char *path, int rows, int cols, int layout)
+{
+  char header[IMAGE_HEADER];
+  int fd;
+
+  if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+    return NULL;
+
+  memcpy(header, IMAGE_MAGIC, 7);
+  header[7] = layout;
+  memcpy(header + 8, &rows, sizeof(int));
+  memcpy(header + 12, &cols, sizeof(int));
+  if (write(fd, header, IMAGE_HEADER) != IMAGE_HEADER ||
+      ftruncate(fd, IMAGE_HEADER + data_size(rows, cols)) < 0) {
+    close(fd);
+    return NULL;
+  }
+
+  return new_image_file(fd, rows, cols, layout, 1);
+}
+
+image_file *image_open(char *path, int writable)
+{
+  char header[IMAGE_HEADER];
+  struct stat st;
+  int fd, rows, cols;
+
+  if ((fd = open(path, writable ? O_RDWR : O_RDONLY)) < 0)
+    return NULL;
+
+  if (read(fd, header, IMAGE_HEADER) != IMAGE_HEADER ||
+      memcmp(header, IMAGE_MAGIC, 7) != 0 ||
+      (header[7] != IMAGE_INTERLEAVED && header[7] != IMAGE_PLANAR)) {
+    close(fd);
+    return NULL;
+  }
+  memcpy(&rows, header + 8, sizeof(int));
+  memcpy(&cols, header + 12, sizeof(int));
+  if (rows < 0 || cols < 0 || fstat(fd, &st) < 0 ||
+      st.st_size < IMAGE_HEADER + data_size(rows, cols)) {
+    close(fd);
+    return NULL;
+  }
+
+  return new_image_file(fd, rows, cols, header[7], writable);
+}
+
+void image_close(image_file *f)
+{
+  if (f == NULL)
+    return;
+  close(f->fd);
+  free(f);
+}
+
+/* Map bytes [start, end) of f, band->pixels points at start */
+static void map_range(image_file *f, off_t start, off_t end, image_band *band)
+{
+  off_t aligned = start & ~((off_t)sysconf(_SC_PAGESIZE) - 1);
+  int prot = PROT_READ | (f->writable ? PROT_WRITE : 0);
+
+  band->len = end - aligned;
+  band->map = mmap(NULL, band->len, prot, MAP_SHARED, f->fd, aligned);
+  if (band->map == MAP_FAILED) {
+    fprintf(stderr, "Fatal error.  mmap failed in map_range\n");
+    exit(1);
+  }
+  if (!f->writable)
+    madvise(band->map, band->len, MADV_SEQUENTIAL);
+
+  band->pixels = (pixel *)((char *)band->map + (start - aligned));
+}
+
+pixel *image_map(image_file *f, int r0, int r1, image_band *band)
+{
+  if (f->layout != IMAGE_INTERLEAVED) {
+    fprintf(stderr, "Fatal error.  image_map needs an interleaved image\n");
+    exit(1);
+  }
+  map_range(f, IMAGE_HEADER + data_size(r0, f->cols),
+            IMAGE_HEADER + data_size(r1, f->cols), band);
+  return band->pixels;
+}
+
+void image_planes(image_file *f, image_band *band, unsigned short **red,
+                  unsigned short **green, unsigned short **blue)
+{
+  long n = (long)f->rows * f->cols;
+
+  if (f->layout != IMAGE_PLANAR) {
+    fprintf(stderr, "Fatal error.  image_planes needs a planar image\n");
+    exit(1);
+  }
+  map_range(f, IMAGE_HEADER, IMAGE_HEADER + data_size(f->rows, f->cols), band);
+  *red = (unsigned short *)band->pixels;
+  *green = *red + n;
+  *blue = *green + n;
+}
+
+void image_unmap(image_band *band)
+{
+  munmap(band->map, band->len);
+}
+
+int image_write(char *path, int rows, int cols, pixel *img, int layout)
+{
+  image_file *f;
+  image_band band;
+  unsigned short *r, *g, *b;
+  long i, n = (long)rows * cols;
+
+  if ((f = image_create(path, rows, cols, layout)) == NULL)
+    return -1;
+
+  if (n > 0) {
+    if (layout == IMAGE_PLANAR) {
+      image_planes(f, &band, &r, &g, &b);
+      for (i = 0; i < n; i++) {
+        r[i] = img[i].red;
+        g[i] = img[i].green;
+        b[i] = img[i].blue;
+      }
+    }
+    else
+      memcpy(image_map(f, 0, rows, &band), img, n * sizeof(pixel));
+    image_unmap(&band);
+  }
+
+  image_close(f);
+  return 0;
+}
+
+pixel *image_read(char *path, int *rows, int *cols)
+{
+  image_file *f;
+  image_band band;
+  unsigned short *r, *g, *b;
+  pixel *img;
+  long i, n;
+
+  if ((f = image_open(path, 0)) == NULL)
+    return NULL;
+
+  n = (long)f->rows * f->cols;
+  if ((img = malloc(n > 0 ? n * sizeof(pixel) : 1)) == NULL) {
+    fprintf(stderr, "Fatal error.  malloc failed in image_read\n");
+    exit(1);
+  }
+
+  if (n > 0) {
+    if (f->layout == IMAGE_PLANAR) {
+      image_planes(f, &band, &r, &g, &b);
+      for (i = 0; i < n; i++) {
+        img[i].red = r[i];
+        img[i].green = g[i];
+        img[i].blue = b[i];
+      }
+    }
+    else
+      memcpy(img, image_map(f, 0, f->rows, &band), n * sizeof(pixel));
+    image_unmap(&band);
+  }
+
+  *rows = f->rows;
+  *cols = f->cols;
+  image_close(f);
+  return img;
+}
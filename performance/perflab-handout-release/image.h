@@ -0,0 +1,69 @@
+/*
+ * image.h - Binary image files for the Performance Lab.
+ *
+ * An image file is a 16 byte header followed by the pixels:
+ *
+ *   bytes 0-6    IMAGE_MAGIC
+ *   byte 7       layout, IMAGE_INTERLEAVED or IMAGE_PLANAR
+ *   bytes 8-11   rows, 32 bit int in host byte order
+ *   bytes 12-15  cols, 32 bit int in host byte order
+ *
+ * Interleaved files hold rows*cols pixels in row major order, the
+ * same bytes as a pixel array. Planar files hold a red plane, then a
+ * green and a blue plane, each rows*cols unsigned shorts. Both can be
+ * mmap'd and used in place.
+ */
+#ifndef _IMAGE_H_
+#define _IMAGE_H_
+
+#include <stddef.h>
+#include "defs.h"
+
+#define IMAGE_MAGIC "PERFLAB"
+#define IMAGE_HEADER 16
+
+#define IMAGE_INTERLEAVED 'I'
+#define IMAGE_PLANAR 'P'
+
+typedef struct {
+  int fd;
+  int rows, cols;
+  int layout;
+  int writable;
+} image_file;
+
+/* The part of an image file mapped by image_map or image_planes */
+typedef struct {
+  void *map;       /* start of the mapping, page aligned */
+  size_t len;      /* length of the mapping */
+  pixel *pixels;   /* first mapped row (interleaved files) */
+} image_band;
+
+/* Create (or truncate) a rows x cols image file, opened read-write.
+   Returns NULL if the file can't be created. */
+image_file *image_create(char *path, int rows, int cols, int layout);
+
+/* Open an existing image file. Returns NULL if it can't be opened or
+   isn't an image file. */
+image_file *image_open(char *path, int writable);
+
+void image_close(image_file *f);
+
+/* Map rows [r0, r1) of an interleaved file, return row r0 */
+pixel *image_map(image_file *f, int r0, int r1, image_band *band);
+
+/* Map all three planes of a planar file */
+void image_planes(image_file *f, image_band *band, unsigned short **red,
+                  unsigned short **green, unsigned short **blue);
+
+void image_unmap(image_band *band);
+
+/* Write a rows x cols pixel array to a new image file with the given
+   layout. Returns 0 on success, -1 on error. */
+int image_write(char *path, int rows, int cols, pixel *img, int layout);
+
+/* Read an image file of either layout into a new malloc'd pixel
+   array. Returns NULL if the file can't be read. */
+pixel *image_read(char *path, int *rows, int *cols);
+
+#endif /* _IMAGE_H_ */
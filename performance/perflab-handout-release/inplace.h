@@ -0,0 +1,18 @@
+/*
+ * inplace.h - complex in place for the Performance Lab.
+ *
+ * complex maps pixel (i,j) to (dim-j-1, dim-i-1), which sends that
+ * pixel back to (i,j), so the image splits into pairs of pixels
+ * mirrored across the anti-diagonal, plus the anti-diagonal itself.
+ * complex_inplace makes both pixels of each pair gray and swaps them,
+ * with no second image and O(1) extra memory.
+ */
+#ifndef _INPLACE_H_
+#define _INPLACE_H_
+
+#include "defs.h"
+
+/* img = complex(img) */
+void complex_inplace(int dim, pixel *img);
+
+#endif /* _INPLACE_H_ */
@@ -0,0 +1,51 @@
+/* Instruction set levels, see isa.h */
+#include <stdio.h>
+#include <string.h>
+
+#include "isa.h"
+
+static int level = -1;  /* -1 = not detected yet */
+
+static char *names[ISA_COUNT] = { "scalar", "sse4.1", "avx2", "avx512" };
+
+isa_level isa_detect(void)
+{
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+    return ISA_AVX512;
+  if (__builtin_cpu_supports("avx2"))
+    return ISA_AVX2;
+  if (__builtin_cpu_supports("sse4.1"))
+    return ISA_SSE41;
+  return ISA_SCALAR;
+}
+
+isa_level isa_current(void)
+{
+  if (level < 0)
+    level = isa_detect();
+  return level;
+}
+
+int isa_force(isa_level l)
+{
+  if (l < ISA_SCALAR || l >= ISA_COUNT || l > isa_detect())
+    return -1;
+  level = l;
+  return 0;
+}
+
+char *isa_name(isa_level l)
+{
+  return (l >= ISA_SCALAR && l < ISA_COUNT) ? names[l] : "unknown";
+}
+
+int isa_lookup(char *name)
+{
+  int l;
+
+  for (l = 0; l < ISA_COUNT; l++)
+    if (strcmp(name, names[l]) == 0)
+      return l;
+  return -1;
+}
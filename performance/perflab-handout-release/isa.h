@@ -0,0 +1,58 @@
+/*
+ * isa.h - Instruction set levels for the Performance Lab kernels.
+ *
+ * Kernels with SIMD variants are compiled once per level from the same
+ * source, with GCC target attributes, and pick one at run time from
+ * isa_level(). That is the best level this CPU (and OS) supports,
+ * found with cpuid the first time it is asked for, unless the driver
+ * forces a lower one with isa_force.
+ */
+#ifndef _ISA_H_
+#define _ISA_H_
+
+typedef enum {
+  ISA_SCALAR,
+  ISA_SSE41,
+  ISA_AVX2,
+  ISA_AVX512,  /* AVX-512F and AVX-512BW */
+  ISA_COUNT
+} isa_level;
+
+/* Best level this CPU supports */
+isa_level isa_detect(void);
+
+/* Level the kernels use */
+isa_level isa_current(void);
+
+/* Make the kernels use level l. Returns -1, and changes nothing, if
+   this CPU doesn't support l. */
+int isa_force(isa_level l);
+
+/* Name of level l, and the level with that name (-1 if none) */
+char *isa_name(isa_level l);
+int isa_lookup(char *name);
+
+/*
+ * ISA_CLONES(name, params, args) - Define name_clones, a table indexed
+ * by isa_level of functions that run name_body(args), each compiled
+ * for its own level. name_body must be a void, always inline function
+ * that uses no intrinsics. The SIMD clones are built with the loop
+ * vectorizer on (-O2 leaves it off), so each one gets vector loops
+ * in the instructions of its level. The scalar clone is plain -O2
+ * code, which on x86-64 may still use SSE2 for scalar arithmetic.
+ */
+#define ISA_VECTORIZE optimize("tree-loop-vectorize", "vect-cost-model=dynamic")
+
+#define ISA_CLONES(name, params, args)                                  \
+  static void name##_scalar params { name##_body args; }                \
+  __attribute__((target("sse4.1"), ISA_VECTORIZE))                      \
+  static void name##_sse41 params { name##_body args; }                 \
+  __attribute__((target("avx2"), ISA_VECTORIZE))                        \
+  static void name##_avx2 params { name##_body args; }                  \
+  __attribute__((target("avx512f,avx512bw"), ISA_VECTORIZE))            \
+  static void name##_avx512 params { name##_body args; }                \
+  static void (*const name##_clones[ISA_COUNT]) params = {              \
+    name##_scalar, name##_sse41, name##_avx2, name##_avx512             \
+  }
+
+#endif /* _ISA_H_ */
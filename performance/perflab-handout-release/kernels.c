@@ -5,6 +5,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "defs.h"
+#include "simd.h"
+#include "pool.h"
+#include "planar.h"
+#include "orient.h"
+#include "tune.h"
+#include "conv.h"
+#include "fused.h"
+#include "isa.h"
+#include "batch.h"
+#include "dirty.h"
+#include "depth.h"
+#include "sat.h"
+#include "inplace.h"
 
 /* 
  * Please fill in the following student struct 
@@ -49,7 +62,33 @@ void naive_complex(int dim, pixel *src, pixel *dest)
     }
 }
 
+/*
+ * complex_block - Scalar complex over the rows [i0, i1) and columns
+ * [j0, j1) of src. Used for the edges the vector versions can't cover.
+ */
+static void complex_block(int dim, pixel *src, pixel *dest,
+                          int i0, int i1, int j0, int j1)
+{
+  int i, j, add_rgb;
+  pixel *s, *d;
+
+  for (i = i0; i < i1; i++)
+  {
+    s = &src[RIDX(i, j0, dim)];
+    d = &dest[RIDX(dim - j0 - 1, dim - i - 1, dim)];
+    for (j = j0; j < j1; j++, s++, d -= dim)
+    {
+      add_rgb = ((int)s->red + (int)s->green + (int)s->blue) / 3;
+      d->red = add_rgb;
+      d->green = add_rgb;
+      d->blue = add_rgb;
+    }
+  }
+}
+
 // My Code added 10/2/23
+// Rows and columns past the last full 8x8 block go to complex_block
+char optimized_complex_descr[] = "optimized_complex: 8x8 blocking";
 void optimized_complex(int dim, pixel* src, pixel* dest)
 {
   int i, j, sub_dimj, sub_dimi, add_rgb, rdix_subs, rdix_ijdim;
@@ -57,9 +96,10 @@ void optimized_complex(int dim, pixel* src, pixel* dest)
   // Prevent Blocking
   int W = 8;
   int ii, jj;
+  int full = dim - dim % W;
 
-  for(i = 0; i < dim; i+=W)
-    for(j = 0; j < dim; j+=W)
+  for(i = 0; i < full; i+=W)
+    for(j = 0; j < full; j+=W)
       for(ii = i; ii < i+W; ii++)
       {
         sub_dimi = dim - ii;
@@ -76,6 +116,277 @@ void optimized_complex(int dim, pixel* src, pixel* dest)
           dest[rdix_subs].blue = add_rgb;
         }
       }
+
+  complex_block(dim, src, dest, 0, full, full, dim);
+  complex_block(dim, src, dest, full, dim, 0, dim);
+}
+
+/*
+ * simd_complex_range - complex with SSE4.1 over the rows [i0, i1) and
+ * columns [j0, j1) of src. Each 8x8 tile is turned into gray values
+ * 8 pixels per row, transposed in registers, and written as 8
+ * contiguous 8 pixel runs of dest. Any rows and columns past the last
+ * full tile are handled by complex_block.
+ */
+__attribute__((target("sse4.1")))
+static void simd_complex_range(int dim, pixel *src, pixel *dest,
+                               int i0, int i1, int j0, int j1)
+{
+  int i, j, k;
+  int iend = i0 + ((i1 - i0) & ~7);
+  int jend = j0 + ((j1 - j0) & ~7);
+  __m128i row[8];
+
+  for (i = i0; i < iend; i += 8)
+    for (j = j0; j < jend; j += 8)
+    {
+      for (k = 0; k < 8; k++)
+        row[k] = sse_gray8(&src[RIDX(i + k, j, dim)]);
+      sse_transpose8(row);
+
+      // Column k of the tile becomes dest row dim - j - k - 1
+      for (k = 0; k < 8; k++)
+        sse_store8(&dest[RIDX(dim - j - k - 1, dim - i - 8, dim)], row[k]);
+    }
+
+  complex_block(dim, src, dest, i0, iend, jend, j1);
+  complex_block(dim, src, dest, iend, i1, j0, j1);
+}
+
+/*
+ * simd_complex - SSE4.1 complex over the whole image, or complex_block
+ * below ISA level SSE4.1
+ */
+char simd_complex_descr[] = "simd_complex: SSE4.1 8x8 tiles with register transpose";
+void simd_complex(int dim, pixel *src, pixel *dest)
+{
+  if (isa_current() >= ISA_SSE41)
+    simd_complex_range(dim, src, dest, 0, dim, 0, dim);
+  else
+    complex_block(dim, src, dest, 0, dim, 0, dim);
+}
+
+/*
+ * parallel_complex - complex split into TILE x TILE tiles that are
+ * run on the worker pool (see pool.h)
+ */
+#define TILE 64
+
+typedef struct {
+  int dim;
+  pixel *src, *dest;
+  int block;   /* tile edge or band height */
+  int unroll;  /* output rows per pass, for blocked_rows */
+} kernel_args;
+
+static void complex_tile_task(void *vargs, int task)
+{
+  kernel_args *a = (kernel_args *)vargs;
+  int tiles = (a->dim + a->block - 1) / a->block;
+  int i0 = (task / tiles) * a->block, j0 = (task % tiles) * a->block;
+  int i1 = (i0 + a->block < a->dim) ? i0 + a->block : a->dim;
+  int j1 = (j0 + a->block < a->dim) ? j0 + a->block : a->dim;
+
+  if (isa_current() >= ISA_SSE41)
+    simd_complex_range(a->dim, a->src, a->dest, i0, i1, j0, j1);
+  else
+    complex_block(a->dim, a->src, a->dest, i0, i1, j0, j1);
+}
+
+char parallel_complex_descr[] = "parallel_complex: 64x64 tiles on the worker pool";
+void parallel_complex(int dim, pixel *src, pixel *dest)
+{
+  kernel_args args = { dim, src, dest, TILE };
+  int tiles = (dim + TILE - 1) / TILE;
+
+  pool_run(complex_tile_task, &args, tiles * tiles);
+}
+
+/*
+ * oblivious_complex - complex as one case of the reorientation engine
+ * (see orient.h): grayscale plus the anti-diagonal flip, with
+ * recursive cache-oblivious blocking
+ */
+char oblivious_complex_descr[] = "oblivious_complex: Cache-oblivious reorientation engine";
+void oblivious_complex(int dim, pixel *src, pixel *dest)
+{
+  reorient(dim, src, dest, ORIENT_ANTI_TRANSPOSE, 1);
+}
+
+/*
+ * tuned_complex - complex with the tile size and thread count that
+ * "driver -T" picked for this host (see tune.h). Each tile goes
+ * through the reorientation engine; tile 0 means a single tile
+ * covering the whole image.
+ */
+static void tuned_tile_task(void *vargs, int task)
+{
+  kernel_args *a = (kernel_args *)vargs;
+  int tiles = (a->dim + a->block - 1) / a->block;
+  int i0 = (task / tiles) * a->block, j0 = (task % tiles) * a->block;
+  int i1 = (i0 + a->block < a->dim) ? i0 + a->block : a->dim;
+  int j1 = (j0 + a->block < a->dim) ? j0 + a->block : a->dim;
+
+  reorient_range(a->dim, a->src, a->dest, ORIENT_ANTI_TRANSPOSE, 1,
+                 i0, i1, j0, j1);
+}
+
+char tuned_complex_descr[] = "tuned_complex: Tile size and threads from the tuning file";
+void tuned_complex(int dim, pixel *src, pixel *dest)
+{
+  complex_tune t = tune_complex(dim);
+  kernel_args args = { dim, src, dest, (t.tile > 0 && t.tile < dim) ? t.tile : dim };
+  int tiles = (dim + args.block - 1) / args.block;
+
+  pool_run_threads(tuned_tile_task, &args, tiles * tiles,
+                   t.threads ? t.threads : pool_threads());
+}
+
+/*
+ * nt_complex - complex for images bigger than the caches. Each task
+ * takes a band of NT_BAND src rows and walks across it 8 columns at a
+ * time: the 4 8x8 tiles are made gray and transposed in registers,
+ * which gives 8 dest rows of NT_BAND contiguous pixels, 192 bytes or
+ * 3 whole cache lines each. Those are written with non-temporal
+ * stores, so dest lines are never read in just to be overwritten and
+ * don't push src out of the cache. The src rows of the band are
+ * prefetched NT_PREFETCH pixels ahead. Needs dim to be a multiple of
+ * NT_BAND and a 16 byte aligned dest, and falls back to
+ * tuned_complex otherwise.
+ */
+#define NT_BAND 32
+#define NT_PREFETCH 64
+
+__attribute__((target("sse4.1")))
+static void nt_band(int dim, pixel *src, pixel *dest, int i)
+{
+  __m128i row[NT_BAND / 8][8];
+  int j, k, t;
+
+  for (j = 0; j < dim; j += 8)
+  {
+    for (k = 0; k < NT_BAND; k++)
+      _mm_prefetch((char *)&src[RIDX(i + k, j + NT_PREFETCH, dim)], _MM_HINT_T0);
+
+    for (t = 0; t < NT_BAND / 8; t++)
+    {
+      for (k = 0; k < 8; k++)
+        row[t][k] = sse_gray8(&src[RIDX(i + 8 * t + k, j, dim)]);
+      sse_transpose8(row[t]);
+    }
+
+    // Dest row dim - j - k - 1 gets the tiles from the bottom one up
+    for (k = 0; k < 8; k++)
+      for (t = NT_BAND / 8 - 1; t >= 0; t--)
+        sse_stream8(&dest[RIDX(dim - j - k - 1, dim - i - 8 * (t + 1), dim)],
+                    row[t][k]);
+  }
+
+  // Non-temporal stores are weakly ordered
+  _mm_sfence();
+}
+
+static void nt_band_task(void *vargs, int task)
+{
+  kernel_args *a = (kernel_args *)vargs;
+
+  nt_band(a->dim, a->src, a->dest, task * NT_BAND);
+}
+
+char nt_complex_descr[] = "nt_complex: Non-temporal stores of whole lines, prefetched src";
+void nt_complex(int dim, pixel *src, pixel *dest)
+{
+  kernel_args args = { dim, src, dest, NT_BAND };
+
+  if (dim % NT_BAND || (long)dest % 16 || isa_current() < ISA_SSE41)
+  {
+    tuned_complex(dim, src, dest);
+    return;
+  }
+  pool_run(nt_band_task, &args, dim / NT_BAND);
+}
+
+/*
+ * complex_inplace - complex without a dest image (see inplace.h).
+ * With dim = 8q + r, the 8x8 tiles of rows [0, 8q) and columns
+ * [r, dim) map onto each other: tile (a,b), counted from row 0 and
+ * column r, pairs with tile (q-b-1, q-a-1). Both tiles of a pair are
+ * loaded and made gray, transposed in registers, and stored into each
+ * other's place, as in simd_complex. The tiles on the anti-diagonal
+ * pair with themselves. The pool runs one TILE x TILE block of tiles
+ * per task, so a task works on two blocks at a time; blocks below the
+ * anti-diagonal have nothing to do, since their pairs were taken from
+ * above it. The bottom r rows and left r columns map onto each other
+ * too and are swapped one pixel pair at a time.
+ */
+#define GRAY(p) (((int)(p).red + (int)(p).green + (int)(p).blue) / 3)
+
+/* Pixel (i,j) and its pair, if (i,j) is above the anti-diagonal */
+static inline void inplace_pixel(int dim, pixel *img, int i, int j)
+{
+  pixel *p = &img[RIDX(i, j, dim)], *q = &img[RIDX(dim - j - 1, dim - i - 1, dim)];
+  int gp, gq;
+
+  if (i + j > dim - 1)
+    return;
+  gp = GRAY(*p);
+  gq = GRAY(*q);
+  p->red = p->green = p->blue = gq;
+  q->red = q->green = q->blue = gp;
+}
+
+__attribute__((target("sse4.1")))
+static void inplace_tiles(int dim, pixel *img, int i, int j)
+{
+  __m128i a[8], b[8];
+  int k, i2 = dim - j - 8, j2 = dim - i - 8;
+
+  for (k = 0; k < 8; k++)
+  {
+    a[k] = sse_gray8(&img[RIDX(i + k, j, dim)]);
+    b[k] = sse_gray8(&img[RIDX(i2 + k, j2, dim)]);
+  }
+  sse_transpose8(a);
+  sse_transpose8(b);
+
+  // Column k of a tile becomes row dim - j - k - 1 of its pair
+  for (k = 0; k < 8; k++)
+    sse_store8(&img[RIDX(i2 + 7 - k, j2, dim)], a[k]);
+  if (i2 != i)
+    for (k = 0; k < 8; k++)
+      sse_store8(&img[RIDX(i + 7 - k, j, dim)], b[k]);
+}
+
+static void inplace_block_task(void *vargs, int task)
+{
+  kernel_args *a = (kernel_args *)vargs;
+  int dim = a->dim, q = dim / 8, r = dim % 8, per = TILE / 8;
+  int blocks = (q + per - 1) / per;
+  int a0 = (task / blocks) * per, b0 = (task % blocks) * per;
+  int ta, tb, k, l, simd = isa_current() >= ISA_SSE41;
+
+  for (ta = a0; ta < a0 + per && ta < q; ta++)
+    for (tb = b0; tb < b0 + per && ta + tb <= q - 1; tb++)
+      if (simd)
+        inplace_tiles(dim, a->dest, 8 * ta, r + 8 * tb);
+      else
+        for (k = 0; k < 8; k++)
+          for (l = 0; l < 8; l++)
+            inplace_pixel(dim, a->dest, 8 * ta + k, r + 8 * tb + l);
+}
+
+void complex_inplace(int dim, pixel *img)
+{
+  kernel_args args = { dim, img, img, TILE };
+  int r = dim % 8, blocks = (dim / 8 + TILE / 8 - 1) / (TILE / 8);
+  int i, j;
+
+  pool_run(inplace_block_task, &args, blocks * blocks);
+
+  // The pairs of the bottom r rows are all in the left r columns
+  for (i = 0; i < dim; i++)
+    for (j = 0; j < r; j++)
+      inplace_pixel(dim, img, i, j);
 }
 
 /* 
@@ -85,7 +396,7 @@ void optimized_complex(int dim, pixel* src, pixel* dest)
 char complex_descr[] = "complex: Current working version";
 void complex(int dim, pixel *src, pixel *dest)
 {
-  optimized_complex(dim, src, dest);
+  tuned_complex(dim, src, dest);
 }
 
 /*********************************************************************
@@ -97,8 +408,17 @@ void complex(int dim, pixel *src, pixel *dest)
  *********************************************************************/
 
 void register_complex_functions() {
+  tune_load(tune_path());
+
   add_complex_function(&complex, complex_descr);
   add_complex_function(&naive_complex, naive_complex_descr);
+  add_complex_function(&simd_complex, simd_complex_descr);
+  add_complex_function(&parallel_complex, parallel_complex_descr);
+  add_complex_function(&optimized_complex, optimized_complex_descr);
+  add_complex_function(&oblivious_complex, oblivious_complex_descr);
+  add_complex_function(&tuned_complex, tuned_complex_descr);
+  add_complex_function(&nt_complex, nt_complex_descr);
+  add_complex_function(&depth_complex, depth_complex_descr);
 }
 
 
@@ -141,383 +461,1022 @@ static pixel weighted_combo(int dim, int i, int j, pixel *src)
   return current_pixel;
 }
 
-// Code Added 10/2/23
-static pixel motion_matrix_3x3_weighted(int dim, int i, int j, pixel *src)
-{
-  pixel current_pixel;
+/*
+ * motion_weights - motion is the 3x3 box filter of the convolution
+ * engine (see conv.h), which generates the 3x3 window and all eight
+ * cut off windows at the bottom and right edges from these weights
+ */
+static const int motion_weights[3 * 3] = {
+  1, 1, 1,
+  1, 1, 1,
+  1, 1, 1
+};
 
-  int num_neighbors = 9;
-  int r, g, b;
-  r = g = b = 0;
-
-  // Indices for Row 1
-  int index_row_00 = RIDX(i, j, dim); // col 1
-  int index_row_01 = RIDX(i, j + 1, dim); // col 2
-  int index_row_02 = RIDX(i, j + 2, dim); // col 3
-
-  // Indices for Row 2
-  int index_row_10 = RIDX(i + 1, j, dim); // col 1
-  int index_row_11 = RIDX(i + 1, j + 1, dim); // col 2
-  int index_row_12 = RIDX(i + 1, j + 2, dim); // col 3
-
-  // Indices for Row 3
-  int index_row_20 = RIDX(i + 2, j, dim); // col 1
-  int index_row_21 = RIDX(i + 2, j + 1, dim); // col 2
-  int index_row_22 = RIDX(i + 2, j + 2, dim); // col 3
-
-  r += (int)(src[index_row_00].red + src[index_row_01].red + src[index_row_02].red
-            + src[index_row_10].red + src[index_row_11].red + src[index_row_12].red
-            + src[index_row_20].red + src[index_row_21].red + src[index_row_22].red);
-
-  b += (int)(src[index_row_00].blue + src[index_row_01].blue + src[index_row_02].blue
-            + src[index_row_10].blue + src[index_row_11].blue + src[index_row_12].blue
-            + src[index_row_20].blue + src[index_row_21].blue + src[index_row_22].blue);
-
-  g += (int)(src[index_row_00].green + src[index_row_01].green + src[index_row_02].green
-            + src[index_row_10].green + src[index_row_11].green + src[index_row_12].green
-            + src[index_row_20].green + src[index_row_21].green + src[index_row_22].green);
-  
-  current_pixel.red = (unsigned short) (r / num_neighbors);
-  current_pixel.green = (unsigned short) (g / num_neighbors);
-  current_pixel.blue = (unsigned short) (b / num_neighbors);
+/******************************************************
+ * Your different versions of the motion kernel go here
+ ******************************************************/
 
-  return current_pixel;
-}
 
-static pixel motion_matrix_2x2_weighted(int dim, int i, int j, pixel *src)
+/*
+ * naive_motion - The naive baseline version of motion 
+ */
+char naive_motion_descr[] = "naive_motion: Naive baseline implementation";
+void naive_motion(int dim, pixel *src, pixel *dst) 
 {
-  pixel current_pixel;
+  int i, j;
+    
+  for (i = 0; i < dim; i++)
+    for (j = 0; j < dim; j++)
+      dst[RIDX(i, j, dim)] = weighted_combo(dim, i, j, src);
+}
 
-  int num_neighbors = 4;
-  int r, g, b;
-  r = g = b = 0;
+// My code 10/2/23
+void optimized_motion(int dim, pixel *src, pixel *dst) 
+{
+  conv_rows(dim, src, dst, 0, dim, 3, motion_weights);
+}
 
-  // Indices for Row 1
-  int index_row_00 = RIDX(i, j, dim);
-  int index_row_01 = RIDX(i, j + 1, dim);
+/*
+ * motion_rows - optimized_motion for the output rows [i0, i1) only,
+ * compiled for each ISA level (see isa.h)
+ */
+static inline __attribute__((always_inline))
+void motion_rows_body(int dim, pixel *src, pixel *dst, int i0, int i1)
+{
+  conv_rows(dim, src, dst, i0, i1, 3, motion_weights);
+}
 
-  // Indices for Row 2
-  int index_row_10 = RIDX(i + 1, j, dim);
-  int index_row_11 = RIDX(i + 1, j + 1, dim);
+ISA_CLONES(motion_rows, (int dim, pixel *src, pixel *dst, int i0, int i1),
+           (dim, src, dst, i0, i1));
 
-  r += (int)(src[index_row_00].red + src[index_row_01].red
-            + src[index_row_10].red + src[index_row_11].red);
+static void motion_rows(int dim, pixel *src, pixel *dst, int i0, int i1)
+{
+  motion_rows_clones[isa_current()](dim, src, dst, i0, i1);
+}
 
-  b += (int)(src[index_row_00].blue + src[index_row_01].blue
-            + src[index_row_10].blue + src[index_row_11].blue);
+/*
+ * parallel_motion - motion split into BAND row bands that are run on
+ * the worker pool (see pool.h)
+ */
+#define BAND 16
 
-  g += (int)(src[index_row_00].green + src[index_row_01].green
-            + src[index_row_10].green + src[index_row_11].green);
-  
-  current_pixel.red = (unsigned short) (r / num_neighbors);
-  current_pixel.green = (unsigned short) (g / num_neighbors);
-  current_pixel.blue = (unsigned short) (b / num_neighbors);
+static void motion_band_task(void *vargs, int task)
+{
+  kernel_args *a = (kernel_args *)vargs;
+  int i0 = task * a->block;
+  int i1 = (i0 + a->block < a->dim) ? i0 + a->block : a->dim;
 
-  return current_pixel;
+  motion_rows(a->dim, a->src, a->dest, i0, i1);
 }
 
-static pixel motion_matrix_2x3_weighted(int dim, int i, int j, pixel *src)
+char parallel_motion_descr[] = "parallel_motion: 16 row bands on the worker pool";
+void parallel_motion(int dim, pixel *src, pixel *dst)
 {
-  pixel current_pixel;
+  kernel_args args = { dim, src, dst, BAND };
 
-  int num_neighbors = 6;
-  int r, g, b;
-  r = g = b = 0;
+  pool_run(motion_band_task, &args, (dim + BAND - 1) / BAND);
+}
 
-  // Indices for Row 1
-  int index_row_00 = RIDX(i, j, dim); // col 1
-  int index_row_01 = RIDX(i, j + 1, dim); // col2
-  int index_row_02 = RIDX(i, j + 2, dim); // col 3
+/*
+ * blocked_motion - motion MOTION_ROWS output rows per pass. The
+ * MOTION_ROWS + 2 src rows under a pass are each loaded once per
+ * position, summed 3 wide, and each of those row sums goes into the
+ * (up to) 3 output rows whose windows cover it, all in registers.
+ * The loop runs over the flat channel array, so the SIMD clones (see
+ * isa.h) do 8 or 16 channels at a time: MOTION_ROWS output vectors
+ * from 3 * (MOTION_ROWS + 2) vector loads. The last 2 columns and the
+ * rows that don't fill a pass go through the convolution engine.
+ * The rows per pass is the unroll factor tuned_motion sweeps; the
+ * loop is also built for 2 and 4 rows.
+ */
+#define MOTION_ROWS 8
 
-  // Indices for Row 2
-  int index_row_10 = RIDX(i + 1, j, dim); // col 1
-  int index_row_11 = RIDX(i + 1, j + 1, dim); // col 2
-  int index_row_12 = RIDX(i + 1, j + 2, dim); // col 3
+static inline __attribute__((always_inline))
+void blocked_pass_body(int dim, pixel *src, pixel *dst, int i0, int i1,
+                       const int rows)
+{
+  const unsigned short *restrict in[MOTION_ROWS + 2];
+  unsigned short *restrict out[MOTION_ROWS];
+  unsigned h[MOTION_ROWS + 2];
+  long e, n = 3L * dim, full = 3L * (dim - 2);
+  int i, r;
 
-  r += (int)(src[index_row_00].red + src[index_row_01].red + src[index_row_02].red
-            + src[index_row_10].red + src[index_row_11].red + src[index_row_12].red);
+  for (i = i0; i + rows <= i1 && i + rows + 2 <= dim; i += rows)
+  {
+    for (r = 0; r < rows + 2; r++)
+      in[r] = (unsigned short *)src + (i + r) * n;
+    for (r = 0; r < rows; r++)
+      out[r] = (unsigned short *)dst + (i + r) * n;
 
-  b += (int)(src[index_row_00].blue + src[index_row_01].blue + src[index_row_02].blue
-            + src[index_row_10].blue + src[index_row_11].blue + src[index_row_12].blue);
+    for (e = 0; e < full; e++)
+    {
+#pragma GCC unroll 16
+      for (r = 0; r < rows + 2; r++)
+        h[r] = in[r][e] + in[r][e + 3] + in[r][e + 6];
+#pragma GCC unroll 16
+      for (r = 0; r < rows; r++)
+        out[r][e] = (h[r] + h[r + 1] + h[r + 2]) / 9;
+    }
 
-  g += (int)(src[index_row_00].green + src[index_row_01].green + src[index_row_02].green
-            + src[index_row_10].green + src[index_row_11].green + src[index_row_12].green);
-  
-  current_pixel.red = (unsigned short) (r / num_neighbors);
-  current_pixel.green = (unsigned short) (g / num_neighbors);
-  current_pixel.blue = (unsigned short) (b / num_neighbors);
+    conv_rect(dim, dim, src, dst, i, i + rows, dim - 2, dim, 3, motion_weights);
+  }
 
-  return current_pixel;
+  conv_rows(dim, src, dst, i, i1, 3, motion_weights);
 }
 
-static pixel motion_matrix_3x2_weighted(int dim, int i, int j, pixel *src)
+static inline __attribute__((always_inline))
+void blocked_rows_body(int dim, pixel *src, pixel *dst, int i0, int i1)
 {
-  pixel current_pixel;
-
-  int num_neighbors = 6;
-  int r, g, b;
-  r = g = b = 0;
-
-  // Indices for Row 1
-  int index_row_00 = RIDX(i, j, dim); // col 1
-  int index_row_01 = RIDX(i, j + 1, dim); // col 2
-
-  // Indices for Row 2
-  int index_row_10 = RIDX(i + 1, j, dim); // col 1
-  int index_row_11 = RIDX(i + 1, j + 1, dim); // col 2
-
-  // Indices for Row 3
-  int index_row_20 = RIDX(i + 2, j, dim); // col 1
-  int index_row_21 = RIDX(i + 2, j + 1, dim); // col 2
+  blocked_pass_body(dim, src, dst, i0, i1, MOTION_ROWS);
+}
 
-  r += (int)(src[index_row_00].red + src[index_row_01].red
-            + src[index_row_10].red + src[index_row_11].red
-            + src[index_row_20].red + src[index_row_21].red);
+static inline __attribute__((always_inline))
+void blocked4_rows_body(int dim, pixel *src, pixel *dst, int i0, int i1)
+{
+  blocked_pass_body(dim, src, dst, i0, i1, 4);
+}
 
-  b += (int)(src[index_row_00].blue + src[index_row_01].blue
-            + src[index_row_10].blue + src[index_row_11].blue
-            + src[index_row_20].blue + src[index_row_21].blue);
+static inline __attribute__((always_inline))
+void blocked2_rows_body(int dim, pixel *src, pixel *dst, int i0, int i1)
+{
+  blocked_pass_body(dim, src, dst, i0, i1, 2);
+}
 
-  g += (int)(src[index_row_00].green + src[index_row_01].green
-            + src[index_row_10].green + src[index_row_11].green
-            + src[index_row_20].green + src[index_row_21].green);
-  
-  current_pixel.red = (unsigned short) (r / num_neighbors);
-  current_pixel.green = (unsigned short) (g / num_neighbors);
-  current_pixel.blue = (unsigned short) (b / num_neighbors);
+ISA_CLONES(blocked_rows, (int dim, pixel *src, pixel *dst, int i0, int i1),
+           (dim, src, dst, i0, i1));
+ISA_CLONES(blocked4_rows, (int dim, pixel *src, pixel *dst, int i0, int i1),
+           (dim, src, dst, i0, i1));
+ISA_CLONES(blocked2_rows, (int dim, pixel *src, pixel *dst, int i0, int i1),
+           (dim, src, dst, i0, i1));
 
-  return current_pixel;
+// Output rows [i0, i1) with unroll rows per pass, 1 = window helpers
+static void blocked_rows(int dim, pixel *src, pixel *dst, int i0, int i1,
+                         int unroll)
+{
+  if (unroll == 2)
+    blocked2_rows_clones[isa_current()](dim, src, dst, i0, i1);
+  else if (unroll == 4)
+    blocked4_rows_clones[isa_current()](dim, src, dst, i0, i1);
+  else if (unroll == MOTION_ROWS)
+    blocked_rows_clones[isa_current()](dim, src, dst, i0, i1);
+  else
+    motion_rows(dim, src, dst, i0, i1);
 }
 
-static pixel motion_matrix_3x1_weighted(int dim, int i, int j, pixel *src)
+static void blocked_band_task(void *vargs, int task)
 {
-  pixel current_pixel;
+  kernel_args *a = (kernel_args *)vargs;
+  int i0 = task * a->block;
+  int i1 = (i0 + a->block < a->dim) ? i0 + a->block : a->dim;
 
-  int num_neighbors = 3;
-  int r, g, b;
-  r = g = b = 0;
+  blocked_rows(a->dim, a->src, a->dest, i0, i1, a->unroll);
+}
 
-  // Indices for Row 1
-  int index_row_00 = RIDX(i, j, dim); // col 1
+char blocked_motion_descr[] = "blocked_motion: 8 output rows per pass from register row sums";
+void blocked_motion(int dim, pixel *src, pixel *dst)
+{
+  kernel_args args = { dim, src, dst, BAND, MOTION_ROWS };
 
-  // Indices for Row 2
-  int index_row_10 = RIDX(i + 1, j, dim); // col 1
+  pool_run(blocked_band_task, &args, (dim + BAND - 1) / BAND);
+}
 
-  // Indices for Row 3
-  int index_row_20 = RIDX(i + 2, j, dim); // col 1
+/*
+ * sliding_motion - motion with rolling column sums. sums[j] holds the
+ * channel sums of column j over the (up to) 3 rows of the current
+ * window; moving down a row subtracts the row that left and adds the
+ * row that entered. Along a row a 3-wide window slides over sums, so
+ * each output costs a few adds no matter how large the window is.
+ */
+typedef struct {
+  int red, green, blue;
+} pixel_sum;
 
-  r += (int)(src[index_row_00].red
-            + src[index_row_10].red
-            + src[index_row_20].red);
+// Slides the window along one output row, rows is 1, 2 or 3
+static inline __attribute__((always_inline))
+void slide_row(int dim, pixel_sum *sums, pixel *out, int rows)
+{
+  int j;
+  pixel_sum w;
 
-  b += (int)(src[index_row_00].blue
-            + src[index_row_10].blue
-            + src[index_row_20].blue);
+  w.red = sums[0].red + sums[1].red + sums[2].red;
+  w.green = sums[0].green + sums[1].green + sums[2].green;
+  w.blue = sums[0].blue + sums[1].blue + sums[2].blue;
 
-  g += (int)(src[index_row_00].green
-            + src[index_row_10].green
-            + src[index_row_20].green);
-  
-  current_pixel.red = (unsigned short) (r / num_neighbors);
-  current_pixel.green = (unsigned short) (g / num_neighbors);
-  current_pixel.blue = (unsigned short) (b / num_neighbors);
+  for (j = 0; j < dim - 3; j++)
+  {
+    out[j].red = w.red / (3 * rows);
+    out[j].green = w.green / (3 * rows);
+    out[j].blue = w.blue / (3 * rows);
+    w.red += sums[j + 3].red - sums[j].red;
+    w.green += sums[j + 3].green - sums[j].green;
+    w.blue += sums[j + 3].blue - sums[j].blue;
+  }
 
-  return current_pixel;
+  // Last three columns, where the window shrinks
+  out[j].red = w.red / (3 * rows);
+  out[j].green = w.green / (3 * rows);
+  out[j].blue = w.blue / (3 * rows);
+  w.red -= sums[j].red;
+  w.green -= sums[j].green;
+  w.blue -= sums[j].blue;
+  j++;
+
+  out[j].red = w.red / (2 * rows);
+  out[j].green = w.green / (2 * rows);
+  out[j].blue = w.blue / (2 * rows);
+  w.red -= sums[j].red;
+  w.green -= sums[j].green;
+  w.blue -= sums[j].blue;
+  j++;
+
+  out[j].red = w.red / rows;
+  out[j].green = w.green / rows;
+  out[j].blue = w.blue / rows;
 }
 
-static pixel motion_matrix_1x3_weighted(int dim, int i, int j, pixel *src)
+/*
+ * sliding_rows - sliding_motion for the output rows [i0, i1) only. The
+ * column sums start from the (up to) 3 rows below i0. Compiled for
+ * each ISA level, like motion_rows.
+ */
+static inline __attribute__((always_inline))
+void sliding_rows_body(int dim, pixel *src, pixel *dst, int i0, int i1)
 {
-  pixel current_pixel;
-
-  int num_neighbors = 3;
-  int r, g, b;
-  r = g = b = 0;
+  int i, j;
+  pixel_sum *sums;
+  pixel *leaving, *entering;
 
-  // Indices for Row 1
-  int index_row_00 = RIDX(i, j, dim); // col 1
-  int index_row_01 = RIDX(i, j + 1, dim); // col 2
-  int index_row_02 = RIDX(i, j + 2, dim); // col 3
+  if (dim < 3)
+  {
+    motion_rows(dim, src, dst, i0, i1);
+    return;
+  }
 
-  r += (int)(src[index_row_00].red + src[index_row_01].red + src[index_row_02].red);
+  if ((sums = malloc(dim * sizeof(pixel_sum))) == NULL)
+  {
+    fprintf(stderr, "malloc failed in sliding_motion\n");
+    exit(1);
+  }
 
-  b += (int)(src[index_row_00].blue + src[index_row_01].blue + src[index_row_02].blue);
+  for (j = 0; j < dim; j++)
+  {
+    sums[j].red = sums[j].green = sums[j].blue = 0;
+    for (i = i0; i < i0 + 3 && i < dim; i++)
+    {
+      sums[j].red += src[RIDX(i, j, dim)].red;
+      sums[j].green += src[RIDX(i, j, dim)].green;
+      sums[j].blue += src[RIDX(i, j, dim)].blue;
+    }
+  }
 
-  g += (int)(src[index_row_00].green + src[index_row_01].green + src[index_row_02].green);
-  
-  current_pixel.red = (unsigned short) (r / num_neighbors);
-  current_pixel.green = (unsigned short) (g / num_neighbors);
-  current_pixel.blue = (unsigned short) (b / num_neighbors);
+  for (i = i0; i < i1; i++)
+  {
+    // Separate calls so each one divides by a constant
+    if (i < dim - 2)
+      slide_row(dim, sums, &dst[RIDX(i, 0, dim)], 3);
+    else if (i == dim - 2)
+      slide_row(dim, sums, &dst[RIDX(i, 0, dim)], 2);
+    else
+      slide_row(dim, sums, &dst[RIDX(i, 0, dim)], 1);
+
+    if (i + 1 == i1)
+      break;
+
+    // Move the window down: drop row i, add row i + 3 if there is one
+    leaving = &src[RIDX(i, 0, dim)];
+    if (i + 3 < dim)
+    {
+      entering = &src[RIDX(i + 3, 0, dim)];
+      for (j = 0; j < dim; j++)
+      {
+        sums[j].red += entering[j].red - leaving[j].red;
+        sums[j].green += entering[j].green - leaving[j].green;
+        sums[j].blue += entering[j].blue - leaving[j].blue;
+      }
+    }
+    else
+      for (j = 0; j < dim; j++)
+      {
+        sums[j].red -= leaving[j].red;
+        sums[j].green -= leaving[j].green;
+        sums[j].blue -= leaving[j].blue;
+      }
+  }
 
-  return current_pixel;
+  free(sums);
 }
 
-static pixel motion_matrix_1x2_weighted(int dim, int i, int j, pixel *src)
+ISA_CLONES(sliding_rows, (int dim, pixel *src, pixel *dst, int i0, int i1),
+           (dim, src, dst, i0, i1));
+
+static void sliding_rows(int dim, pixel *src, pixel *dst, int i0, int i1)
 {
-  pixel current_pixel;
+  sliding_rows_clones[isa_current()](dim, src, dst, i0, i1);
+}
 
-  int num_neighbors = 2;
-  int r, g, b;
-  r = g = b = 0;
+char sliding_motion_descr[] = "sliding_motion: Rolling column sums with a sliding window";
+void sliding_motion(int dim, pixel *src, pixel *dst)
+{
+  sliding_rows(dim, src, dst, 0, dim);
+}
 
-  // Indices for Row 1
-  int index_row_00 = RIDX(i, j , dim); // col 1
-  int index_row_01 = RIDX(i, j + 1, dim); // col 2
+/*
+ * tuned_motion - motion with the band height, thread count, loop
+ * structure (rolling sums or window helpers) and rows per pass of the
+ * window loop that "driver -T" picked for this host (see tune.h)
+ */
+static void sliding_band_task(void *vargs, int task)
+{
+  kernel_args *a = (kernel_args *)vargs;
+  int i0 = task * a->block;
+  int i1 = (i0 + a->block < a->dim) ? i0 + a->block : a->dim;
 
-  r += (int)(src[index_row_00].red
-            + src[index_row_01].red);
+  sliding_rows(a->dim, a->src, a->dest, i0, i1);
+}
 
-  b += (int)(src[index_row_00].blue
-            + src[index_row_01].blue);
+char tuned_motion_descr[] = "tuned_motion: Bands, threads and loops from the tuning file";
+void tuned_motion(int dim, pixel *src, pixel *dst)
+{
+  motion_tune t = tune_motion(dim);
+  kernel_args args = { dim, src, dst, t.band, t.unroll };
 
-  g += (int)(src[index_row_00].green
-            + src[index_row_01].green);
-  
-  current_pixel.red = (unsigned short) (r / num_neighbors);
-  current_pixel.green = (unsigned short) (g / num_neighbors);
-  current_pixel.blue = (unsigned short) (b / num_neighbors);
+  pool_run_threads(t.rolling ? sliding_band_task : blocked_band_task, &args,
+                   (dim + t.band - 1) / t.band,
+                   t.threads ? t.threads : pool_threads());
+}
 
-  return current_pixel;
+/*
+ * sat_motion - motion as the 3x3 case of the summed-area table box
+ * average (see sat.h), which costs the same for any window size
+ */
+char sat_motion_descr[] = "sat_motion: 3x3 box average from a summed-area table";
+void sat_motion(int dim, pixel *src, pixel *dst)
+{
+  box_motion(dim, src, dst, 3);
 }
 
-static pixel motion_matrix_2x1_weighted(int dim, int i, int j, pixel *src)
+/*
+ * motion - Your current working version of motion. 
+ * IMPORTANT: This is the version you will be graded on
+ */
+char motion_descr[] = "motion: Current working version";
+void motion(int dim, pixel *src, pixel *dst) 
 {
-  pixel current_pixel;
+  tuned_motion(dim, src, dst);
+}
 
-  int num_neighbors = 2;
-  int r, g, b;
-  r = g = b = 0;
+/********************************************************************* 
+ * register_motion_functions - Register all of your different versions
+ *     of the motion kernel with the driver by calling the
+ *     add_motion_function() for each test function.  When you run the
+ *     driver program, it will test and report the performance of each
+ *     registered test function.  
+ *********************************************************************/
 
-  // Indices for Row 1
-  int index_row_00 = RIDX(i, j , dim); // col 1
+void register_motion_functions() {
+  add_motion_function(&motion, motion_descr);
+  add_motion_function(&naive_motion, naive_motion_descr);
+  add_motion_function(&parallel_motion, parallel_motion_descr);
+  add_motion_function(&sliding_motion, sliding_motion_descr);
+  add_motion_function(&tuned_motion, tuned_motion_descr);
+  add_motion_function(&sat_motion, sat_motion_descr);
+  add_motion_function(&blocked_motion, blocked_motion_descr);
+  add_motion_function(&depth_motion, depth_motion_descr);
+}
 
-  // Indices for Row 2
-  int index_row_10 = RIDX(i + 1, j, dim); // col 1
 
-  r += (int)(src[index_row_00].red
-            + src[index_row_10].red);
+/***************
+ * PLANAR KERNELS
+ ***************/
 
-  b += (int)(src[index_row_00].blue
-            + src[index_row_10].blue);
+/******************************************************
+ * Versions of complex and motion that work on planar
+ * images (see planar.h) instead of pixel arrays
+ ******************************************************/
 
-  g += (int)(src[index_row_00].green
-            + src[index_row_10].green);
-  
-  current_pixel.red = (unsigned short) (r / num_neighbors);
-  current_pixel.green = (unsigned short) (g / num_neighbors);
-  current_pixel.blue = (unsigned short) (b / num_neighbors);
+/*
+ * planar_complex_block - Scalar planar complex over the rows [i0, i1)
+ * and columns [j0, j1) of src
+ */
+static void planar_complex_block(planar_image *src, planar_image *dest,
+                                 int i0, int i1, int j0, int j1)
+{
+  int i, j, gray, idx, dim = src->dim;
 
-  return current_pixel;
+  for (i = i0; i < i1; i++)
+    for (j = j0; j < j1; j++)
+    {
+      idx = PIDX(src, i, j);
+      gray = ((int)src->red[idx] + (int)src->green[idx] + (int)src->blue[idx]) / 3;
+      idx = PIDX(dest, dim - j - 1, dim - i - 1);
+      dest->red[idx] = gray;
+      dest->green[idx] = gray;
+      dest->blue[idx] = gray;
+    }
 }
 
+/*
+ * planar_complex - complex on planar images. The same 8x8 tiles as
+ * simd_complex, but the channels come straight from vector loads and
+ * each transposed column is stored to the three planes as is.
+ */
+__attribute__((target("sse4.1")))
+static void planar_complex_sse(planar_image *src, planar_image *dest)
+{
+  int i, j, k, idx, dim = src->dim;
+  int full = dim & ~7;
+  __m128i row[8], v;
 
-/******************************************************
- * Your different versions of the motion kernel go here
- ******************************************************/
+  for (i = 0; i < full; i += 8)
+    for (j = 0; j < full; j += 8)
+    {
+      for (k = 0; k < 8; k++)
+      {
+        idx = PIDX(src, i + k, j);
+        row[k] = sse_gray(_mm_loadu_si128((__m128i *)&src->red[idx]),
+                          _mm_loadu_si128((__m128i *)&src->green[idx]),
+                          _mm_loadu_si128((__m128i *)&src->blue[idx]));
+      }
+      sse_transpose8(row);
 
+      // Column k of the tile becomes dest row dim - j - k - 1
+      for (k = 0; k < 8; k++)
+      {
+        idx = PIDX(dest, dim - j - k - 1, dim - i - 8);
+        v = sse_reverse8(row[k]);
+        _mm_storeu_si128((__m128i *)&dest->red[idx], v);
+        _mm_storeu_si128((__m128i *)&dest->green[idx], v);
+        _mm_storeu_si128((__m128i *)&dest->blue[idx], v);
+      }
+    }
+
+  planar_complex_block(src, dest, 0, full, full, dim);
+  planar_complex_block(src, dest, full, dim, 0, dim);
+}
+
+char planar_complex_descr[] = "planar_complex: SSE4.1 8x8 tiles on color planes";
+void planar_complex(planar_image *src, planar_image *dest)
+{
+  if (isa_current() >= ISA_SSE41)
+    planar_complex_sse(src, dest);
+  else
+    planar_complex_block(src, dest, 0, src->dim, 0, src->dim);
+}
 
 /*
- * naive_motion - The naive baseline version of motion 
+ * planar_motion - sliding_motion on one plane at a time. With a
+ * single channel per plane the column sum updates are plain int
+ * loops that the compiler vectorizes.
  */
-char naive_motion_descr[] = "naive_motion: Naive baseline implementation";
-void naive_motion(int dim, pixel *src, pixel *dst) 
+// Slides the window along one output row of a plane, rows is 1, 2 or 3
+static inline __attribute__((always_inline))
+void slide_plane_row(int dim, int *sums, unsigned short *out, int rows)
 {
-  int i, j;
-    
-  for (i = 0; i < dim; i++)
-    for (j = 0; j < dim; j++)
-      dst[RIDX(i, j, dim)] = weighted_combo(dim, i, j, src);
+  int j, w = sums[0] + sums[1] + sums[2];
+
+  for (j = 0; j < dim - 3; j++)
+  {
+    out[j] = w / (3 * rows);
+    w += sums[j + 3] - sums[j];
+  }
+
+  // Last three columns, where the window shrinks
+  out[j] = w / (3 * rows);
+  w -= sums[j];
+  out[j + 1] = w / (2 * rows);
+  w -= sums[j + 1];
+  out[j + 2] = w / rows;
 }
 
-// My code 10/2/23
-void optimized_motion(int dim, pixel *src, pixel *dst) 
+static void plane_motion(planar_image *src, unsigned short *splane,
+                         planar_image *dst, unsigned short *dplane, int *sums)
 {
-  int i, j;
-  int index = 0;
+  int i, j, dim = src->dim;
+  unsigned short *leaving, *entering;
+
+  for (j = 0; j < dim; j++)
+    sums[j] = splane[PIDX(src, 0, j)] + splane[PIDX(src, 1, j)] + splane[PIDX(src, 2, j)];
 
-  // -------------------- Handle 3x3 motions -------------------- //
   for (i = 0; i < dim - 2; i++)
-    for (j = 0; j < dim - 2; j++)
+  {
+    slide_plane_row(dim, sums, &dplane[PIDX(dst, i, 0)], 3);
+
+    leaving = &splane[PIDX(src, i, 0)];
+    if (i + 3 < dim)
     {
-      index = RIDX(i, j, dim);
-      dst[index] = motion_matrix_3x3_weighted(dim, i, j, src);
+      entering = &splane[PIDX(src, i + 3, 0)];
+      for (j = 0; j < dim; j++)
+        sums[j] += entering[j] - leaving[j];
     }
+    else
+      for (j = 0; j < dim; j++)
+        sums[j] -= leaving[j];
+  }
+
+  slide_plane_row(dim, sums, &dplane[PIDX(dst, dim - 2, 0)], 2);
+  leaving = &splane[PIDX(src, dim - 2, 0)];
+  for (j = 0; j < dim; j++)
+    sums[j] -= leaving[j];
+  slide_plane_row(dim, sums, &dplane[PIDX(dst, dim - 1, 0)], 1);
+}
+
+char planar_motion_descr[] = "planar_motion: Rolling column sums on color planes";
+void planar_motion(planar_image *src, planar_image *dst)
+{
+  int i, j, ii, jj, n, dim = src->dim;
+  int r, g, b;
+  int *sums;
 
-  // -------------------- Handle Last 2 Rows (2x3) -------------------- //
-  i = dim - 2;
-  for (j = 0; j < dim - 2; j++)
+  // Too small for a full window, average whatever is there
+  if (dim < 3)
   {
-    index = RIDX(i, j, dim);
-    dst[index] = motion_matrix_2x3_weighted(dim, i, j, src);
+    for (i = 0; i < dim; i++)
+      for (j = 0; j < dim; j++)
+      {
+        r = g = b = n = 0;
+        for (ii = i; ii < dim; ii++)
+          for (jj = j; jj < dim; jj++, n++)
+          {
+            r += src->red[PIDX(src, ii, jj)];
+            g += src->green[PIDX(src, ii, jj)];
+            b += src->blue[PIDX(src, ii, jj)];
+          }
+        dst->red[PIDX(dst, i, j)] = r / n;
+        dst->green[PIDX(dst, i, j)] = g / n;
+        dst->blue[PIDX(dst, i, j)] = b / n;
+      }
+    return;
   }
 
-  i = dim - 1;
-  for (j = 0; j < dim - 2; j++)
+  if ((sums = malloc(dim * sizeof(int))) == NULL)
   {
-    index = RIDX(i, j, dim);
-    dst[index] = motion_matrix_1x3_weighted(dim, i, j, src);
+    fprintf(stderr, "malloc failed in planar_motion\n");
+    exit(1);
   }
 
-  // -------------------- Handle Last 2 Columns (3x2) -------------------- //
-  j = dim - 2;
-  for (i = 0; i < dim - 2; i++)
+  plane_motion(src, src->red, dst, dst->red, sums);
+  plane_motion(src, src->green, dst, dst->green, sums);
+  plane_motion(src, src->blue, dst, dst->blue, sums);
+
+  free(sums);
+}
+
+/*********************************************************************
+ * register_planar_functions - Register the planar versions of complex
+ *     and motion with the driver. The driver times them both on planar
+ *     images and with the pixel <-> planar conversions included.
+ *********************************************************************/
+
+void register_planar_functions() {
+  add_planar_complex_function(&planar_complex, planar_complex_descr);
+  add_planar_motion_function(&planar_motion, planar_motion_descr);
+}
+
+
+/***************
+ * FUSED KERNEL
+ ***************/
+
+/*
+ * complex_then_motion - motion(complex(src)) in one pass over FUSE x
+ * FUSE output tiles. A tile of motion needs the complex output tile
+ * plus a 2 pixel halo below and to the right; that gray block is
+ * built from src into a small buffer that stays in L1, and motion
+ * reads it from there. complex output is gray, so motion only has
+ * to average one channel instead of three.
+ */
+#define FUSE 32
+
+// Slides the window along one output row of a tile, rows is 1, 2 or 3
+static inline __attribute__((always_inline))
+void fused_row(int dim, int *sums, pixel *out, int j0, int j1, int rows)
+{
+  int j, v;
+
+  for (j = j0; j < j1; j++)
   {
-    index = RIDX(i, j, dim);
-    dst[index] = motion_matrix_3x2_weighted(dim, i, j, src);
+    if (j < dim - 2)
+      v = (sums[j - j0] + sums[j - j0 + 1] + sums[j - j0 + 2]) / (3 * rows);
+    else if (j == dim - 2)
+      v = (sums[j - j0] + sums[j - j0 + 1]) / (2 * rows);
+    else
+      v = sums[j - j0] / rows;
+    out[j].red = v;
+    out[j].green = v;
+    out[j].blue = v;
   }
+}
 
-  j = dim - 1;
-  for (i = 0; i < dim - 2; i++)
+static void fused_tile(int dim, pixel *src, pixel *dst,
+                       int i0, int i1, int j0, int j1)
+{
+  // gray[a][b] is complex output pixel (i0 + a, j0 + b)
+  int gray[FUSE + 2][FUSE + 2];
+  int sums[FUSE + 2];
+  int iend = (i1 + 2 < dim) ? i1 + 2 : dim;
+  int jend = (j1 + 2 < dim) ? j1 + 2 : dim;
+  int a, b, i;
+  pixel *s;
+
+  // complex output (a, b) is src (dim-1-b, dim-1-a): one src row per b
+  for (b = j0; b < jend; b++)
+  {
+    s = &src[RIDX(dim - 1 - b, dim - 1 - i0, dim)];
+    for (a = i0; a < iend; a++, s--)
+      gray[a - i0][b - j0] = ((int)s->red + (int)s->green + (int)s->blue) / 3;
+  }
+
+  for (i = i0; i < i1; i++)
   {
-    index = RIDX(i, j, dim);
-    dst[index] = motion_matrix_3x1_weighted(dim, i, j, src);
+    a = i - i0;
+    if (i < dim - 2)
+    {
+      for (b = 0; b < jend - j0; b++)
+        sums[b] = gray[a][b] + gray[a + 1][b] + gray[a + 2][b];
+      fused_row(dim, sums, &dst[RIDX(i, 0, dim)], j0, j1, 3);
+    }
+    else if (i == dim - 2)
+    {
+      for (b = 0; b < jend - j0; b++)
+        sums[b] = gray[a][b] + gray[a + 1][b];
+      fused_row(dim, sums, &dst[RIDX(i, 0, dim)], j0, j1, 2);
+    }
+    else
+    {
+      for (b = 0; b < jend - j0; b++)
+        sums[b] = gray[a][b];
+      fused_row(dim, sums, &dst[RIDX(i, 0, dim)], j0, j1, 1);
+    }
   }
+}
 
-  // -------------------- Handle Bottom Right Corner (2x2) -------------------- //
+static void fused_tile_task(void *vargs, int task)
+{
+  kernel_args *a = (kernel_args *)vargs;
+  int tiles = (a->dim + a->block - 1) / a->block;
+  int i0 = (task / tiles) * a->block, j0 = (task % tiles) * a->block;
+  int i1 = (i0 + a->block < a->dim) ? i0 + a->block : a->dim;
+  int j1 = (j0 + a->block < a->dim) ? j0 + a->block : a->dim;
 
-  // Top Left Corner
-  i = dim - 2;
-  j = dim - 2;
-  index = RIDX(i, j, dim);
-  dst[index] = motion_matrix_2x2_weighted(dim, i, j, src);
+  fused_tile(a->dim, a->src, a->dest, i0, i1, j0, j1);
+}
 
-  // Top Right Corner
-  i = dim - 2;
-  j = dim - 1;
-  index = RIDX(i, j, dim);
-  dst[index] = motion_matrix_2x1_weighted(dim, i, j, src);
+char complex_then_motion_descr[] = "complex_then_motion: Fused 32x32 tiles with an L1 gray buffer";
+void complex_then_motion(int dim, pixel *src, pixel *dst)
+{
+  kernel_args args = { dim, src, dst, FUSE };
+  int tiles = (dim + FUSE - 1) / FUSE;
 
-  // Bottom Left Corner
-  i = dim - 1;
-  j = dim - 2;
-  index = RIDX(i, j, dim);
-  dst[index] = motion_matrix_1x2_weighted(dim, i, j, src);
+  pool_run(fused_tile_task, &args, tiles * tiles);
+}
 
-  // Last Corner
-  i = dim - 1;
-  j = dim - 1;
-  index = RIDX(i, j, dim);
-  dst[index] = src[index];
+void register_fused_functions() {
+  add_fused_function(&complex_then_motion, complex_then_motion_descr);
 }
 
+
+/***************
+ * FILTERS
+ ***************/
+
 /*
- * motion - Your current working version of motion. 
- * IMPORTANT: This is the version you will be graded on
+ * Other instances of the convolution engine (see conv.h) than motion's
+ * 3x3 box, built the same way as motion_rows: one clone per ISA level,
+ * one pass over the image. "driver -G" checks them against a direct
+ * weighted average of every window and times them next to box3.
  */
-char motion_descr[] = "motion: Current working version";
-void motion(int dim, pixel *src, pixel *dst) 
+static const int box5_weights[5 * 5] = {
+  1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1
+};
+
+static const int gauss3_weights[3 * 3] = {
+  1, 2, 1,
+  2, 4, 2,
+  1, 2, 1
+};
+
+static const int weighted4_weights[4 * 4] = {
+  1, 2, 2, 1,
+  2, 4, 4, 2,
+  2, 4, 4, 2,
+  1, 2, 2, 1
+};
+
+static inline __attribute__((always_inline))
+void box5_rows_body(int dim, pixel *src, pixel *dst, int i0, int i1)
 {
-  optimized_motion(dim, src, dst);
+  conv_rows(dim, src, dst, i0, i1, 5, box5_weights);
 }
 
-/********************************************************************* 
- * register_motion_functions - Register all of your different versions
- *     of the motion kernel with the driver by calling the
- *     add_motion_function() for each test function.  When you run the
- *     driver program, it will test and report the performance of each
- *     registered test function.  
+static inline __attribute__((always_inline))
+void gauss3_rows_body(int dim, pixel *src, pixel *dst, int i0, int i1)
+{
+  conv_rows(dim, src, dst, i0, i1, 3, gauss3_weights);
+}
+
+static inline __attribute__((always_inline))
+void weighted4_rows_body(int dim, pixel *src, pixel *dst, int i0, int i1)
+{
+  conv_rows(dim, src, dst, i0, i1, 4, weighted4_weights);
+}
+
+ISA_CLONES(box5_rows, (int dim, pixel *src, pixel *dst, int i0, int i1),
+           (dim, src, dst, i0, i1));
+ISA_CLONES(gauss3_rows, (int dim, pixel *src, pixel *dst, int i0, int i1),
+           (dim, src, dst, i0, i1));
+ISA_CLONES(weighted4_rows, (int dim, pixel *src, pixel *dst, int i0, int i1),
+           (dim, src, dst, i0, i1));
+
+char box3_descr[] = "box3: 3x3 box, motion's instance of the engine";
+void box3_filter(int dim, pixel *src, pixel *dst)
+{
+  motion_rows(dim, src, dst, 0, dim);
+}
+
+char box5_descr[] = "box5: 5x5 box";
+void box5_filter(int dim, pixel *src, pixel *dst)
+{
+  box5_rows_clones[isa_current()](dim, src, dst, 0, dim);
+}
+
+char gauss3_descr[] = "gauss3: 3x3 binomial (Gaussian) weights";
+void gauss3_filter(int dim, pixel *src, pixel *dst)
+{
+  gauss3_rows_clones[isa_current()](dim, src, dst, 0, dim);
+}
+
+char weighted4_descr[] = "weighted4: 4x4 separable 1 2 2 1 weights";
+void weighted4_filter(int dim, pixel *src, pixel *dst)
+{
+  weighted4_rows_clones[isa_current()](dim, src, dst, 0, dim);
+}
+
+void register_conv_functions() {
+  add_conv_function(&box3_filter, box3_descr, 3, motion_weights);
+  add_conv_function(&box5_filter, box5_descr, 5, box5_weights);
+  add_conv_function(&gauss3_filter, gauss3_descr, 3, gauss3_weights);
+  add_conv_function(&weighted4_filter, weighted4_descr, 4, weighted4_weights);
+}
+
+
+/***************
+ * BATCH KERNELS
+ ***************/
+
+/*
+ * complex_batch, motion_batch - One pool task per frame (see batch.h).
+ * Each frame runs the single threaded oblivious_complex or
+ * sliding_motion, so the pool is never entered from inside a task.
+ * With fewer frames than threads, the frames go one at a time through
+ * complex() and motion() instead, which split each frame.
+ */
+typedef struct {
+  int dim;
+  pixel **src, **dst;
+} batch_args;
+
+static void complex_frame_task(void *vargs, int task)
+{
+  batch_args *a = (batch_args *)vargs;
+
+  oblivious_complex(a->dim, a->src[task], a->dst[task]);
+}
+
+static void motion_frame_task(void *vargs, int task)
+{
+  batch_args *a = (batch_args *)vargs;
+
+  sliding_motion(a->dim, a->src[task], a->dst[task]);
+}
+
+void complex_batch(int dim, pixel **src, pixel **dst, int nframes)
+{
+  batch_args args = { dim, src, dst };
+  int f;
+
+  if (nframes < pool_threads())
+    for (f = 0; f < nframes; f++)
+      complex(dim, src[f], dst[f]);
+  else
+    pool_run(complex_frame_task, &args, nframes);
+}
+
+void motion_batch(int dim, pixel **src, pixel **dst, int nframes)
+{
+  batch_args args = { dim, src, dst };
+  int f;
+
+  if (nframes < pool_threads())
+    for (f = 0; f < nframes; f++)
+      motion(dim, src[f], dst[f]);
+  else
+    pool_run(motion_frame_task, &args, nframes);
+}
+
+
+/********************
+ * INCREMENTAL MOTION
+ ********************/
+
+/*
+ * motion_incremental - See dirty.h. The output tiles to redo go on
+ * the worker pool, each filtered with the convolution engine over just
+ * its rectangle. When every tile has to be redone, this is motion().
+ */
+static inline __attribute__((always_inline))
+void motion_rect_body(int dim, pixel *src, pixel *dst,
+                      int i0, int i1, int j0, int j1)
+{
+  conv_rect(dim, dim, src, dst, i0, i1, j0, j1, 3, motion_weights);
+}
+
+ISA_CLONES(motion_rect,
+           (int dim, pixel *src, pixel *dst, int i0, int i1, int j0, int j1),
+           (dim, src, dst, i0, i1, j0, j1));
+
+typedef struct {
+  int dim;
+  pixel *src, *dst;
+  int tiles;
+  int *todo;  /* output tiles to redo, as ti * tiles + tj */
+} incremental_args;
+
+static void incremental_tile_task(void *vargs, int task)
+{
+  incremental_args *a = (incremental_args *)vargs;
+  int i0 = (a->todo[task] / a->tiles) * DIRTY_TILE;
+  int j0 = (a->todo[task] % a->tiles) * DIRTY_TILE;
+  int i1 = (i0 + DIRTY_TILE < a->dim) ? i0 + DIRTY_TILE : a->dim;
+  int j1 = (j0 + DIRTY_TILE < a->dim) ? j0 + DIRTY_TILE : a->dim;
+
+  motion_rect_clones[isa_current()](a->dim, a->src, a->dst, i0, i1, j0, j1);
+}
+
+void motion_incremental(int dim, pixel *src, pixel *dst, dirty_map *m)
+{
+  incremental_args args = { dim, src, dst, m->tiles };
+  int ti, tj, n = 0, tiles = m->tiles;
+  unsigned char *map = m->map;
+
+  if ((args.todo = malloc(tiles * tiles * sizeof(int))) == NULL)
+  {
+    fprintf(stderr, "malloc failed in motion_incremental\n");
+    exit(1);
+  }
+
+  // Output tile (ti,tj) reads src tiles (ti..ti+1, tj..tj+1)
+  for (ti = 0; ti < tiles; ti++)
+    for (tj = 0; tj < tiles; tj++)
+      if (map[ti * tiles + tj] ||
+          (tj + 1 < tiles && map[ti * tiles + tj + 1]) ||
+          (ti + 1 < tiles && map[(ti + 1) * tiles + tj]) ||
+          (ti + 1 < tiles && tj + 1 < tiles && map[(ti + 1) * tiles + tj + 1]))
+        args.todo[n++] = ti * tiles + tj;
+
+  if (n == tiles * tiles)
+    motion(dim, src, dst);
+  else if (n > 0)
+    pool_run(incremental_tile_task, &args, n);
+
+  free(args.todo);
+}
+
+
+/***************
+ * PIXEL DEPTH KERNELS
+ ***************/
+
+/*
+ * complex and motion from the channel depth templates (see depth.h):
+ * complex8 and motion8 on 8 bit pixel8 images, depth_complex and
+ * depth_motion on ordinary 16 bit pixels from the very same code.
+ * complex goes over TILE x TILE tiles and motion over DEPTH_BAND row
+ * bands on the worker pool; the motion bands are compiled for each
+ * ISA level (see isa.h), since their flat channel loops vectorize.
+ */
+#define DEPTH_BAND 32
+
+typedef struct {
+  int dim;
+  void *src, *dest;
+} depth_args;
+
+DEPTH_INLINE void depth_complex_task(void *vargs, int task, const int depth)
+{
+  depth_args *a = (depth_args *)vargs;
+  int tiles = (a->dim + TILE - 1) / TILE;
+  int i0 = (task / tiles) * TILE, j0 = (task % tiles) * TILE;
+  int i1 = (i0 + TILE < a->dim) ? i0 + TILE : a->dim;
+  int j1 = (j0 + TILE < a->dim) ? j0 + TILE : a->dim;
+
+  depth_complex_block(a->dim, a->src, a->dest, i0, i1, j0, j1, depth);
+}
+
+static void complex8_task(void *vargs, int task)
+{
+  depth_complex_task(vargs, task, 1);
+}
+
+static void complex16_task(void *vargs, int task)
+{
+  depth_complex_task(vargs, task, 2);
+}
+
+DEPTH_INLINE void depth_band_body(int dim, void *src, void *dst,
+                                  int i0, int i1, const int depth)
+{
+  int *sums = malloc(3L * dim * sizeof(int));
+
+  if (sums == NULL)
+  {
+    fprintf(stderr, "malloc failed in depth_motion\n");
+    exit(1);
+  }
+  depth_motion_rows(dim, src, dst, i0, i1, sums, depth);
+  free(sums);
+}
+
+static inline __attribute__((always_inline))
+void motion8_band_body(int dim, void *src, void *dst, int i0, int i1)
+{
+  depth_band_body(dim, src, dst, i0, i1, 1);
+}
+
+static inline __attribute__((always_inline))
+void motion16_band_body(int dim, void *src, void *dst, int i0, int i1)
+{
+  depth_band_body(dim, src, dst, i0, i1, 2);
+}
+
+ISA_CLONES(motion8_band, (int dim, void *src, void *dst, int i0, int i1),
+           (dim, src, dst, i0, i1));
+ISA_CLONES(motion16_band, (int dim, void *src, void *dst, int i0, int i1),
+           (dim, src, dst, i0, i1));
+
+static void motion8_task(void *vargs, int task)
+{
+  depth_args *a = (depth_args *)vargs;
+  int i0 = task * DEPTH_BAND;
+  int i1 = (i0 + DEPTH_BAND < a->dim) ? i0 + DEPTH_BAND : a->dim;
+
+  motion8_band_clones[isa_current()](a->dim, a->src, a->dest, i0, i1);
+}
+
+static void motion16_task(void *vargs, int task)
+{
+  depth_args *a = (depth_args *)vargs;
+  int i0 = task * DEPTH_BAND;
+  int i1 = (i0 + DEPTH_BAND < a->dim) ? i0 + DEPTH_BAND : a->dim;
+
+  motion16_band_clones[isa_current()](a->dim, a->src, a->dest, i0, i1);
+}
+
+char complex8_descr[] = "complex8: 8 bit channels, 64x64 tiles on the worker pool";
+void complex8(int dim, pixel8 *src, pixel8 *dest)
+{
+  depth_args args = { dim, src, dest };
+  int tiles = (dim + TILE - 1) / TILE;
+
+  pool_run(complex8_task, &args, tiles * tiles);
+}
+
+char depth_complex_descr[] = "depth_complex: complex8 built for 16 bit channels";
+void depth_complex(int dim, pixel *src, pixel *dest)
+{
+  depth_args args = { dim, src, dest };
+  int tiles = (dim + TILE - 1) / TILE;
+
+  pool_run(complex16_task, &args, tiles * tiles);
+}
+
+char motion8_descr[] = "motion8: 8 bit channels, flat column sums in 32 row bands";
+void motion8(int dim, pixel8 *src, pixel8 *dst)
+{
+  depth_args args = { dim, src, dst };
+
+  pool_run(motion8_task, &args, (dim + DEPTH_BAND - 1) / DEPTH_BAND);
+}
+
+char depth_motion_descr[] = "depth_motion: motion8 built for 16 bit channels";
+void depth_motion(int dim, pixel *src, pixel *dst)
+{
+  depth_args args = { dim, src, dst };
+
+  pool_run(motion16_task, &args, (dim + DEPTH_BAND - 1) / DEPTH_BAND);
+}
+
+/*********************************************************************
+ * register_pixel8_functions - Register the 8 bit versions of complex
+ *     and motion with the driver, which times them with "driver -8".
+ *     Their 16 bit builds are registered by register_complex_functions
+ *     and register_motion_functions.
  *********************************************************************/
 
-void register_motion_functions() {
-  add_motion_function(&motion, motion_descr);
-  add_motion_function(&naive_motion, naive_motion_descr);
+void register_pixel8_functions() {
+  add_pixel8_complex_function(&complex8, complex8_descr);
+  add_pixel8_motion_function(&motion8, motion8_descr);
 }
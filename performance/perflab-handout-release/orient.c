@@ -0,0 +1,226 @@
+/* Cache-oblivious image reorientation, see orient.h */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "defs.h"
+#include "orient.h"
+#include "simd.h"
+#include "isa.h"
+
+/* Pieces at most LEAF x LEAF pixels are not split any further */
+#define LEAF 32
+
+/*
+ * Everything about one reorient call. Src pixel (i,j) goes to
+ * dest[base + i*di + j*dj]. When swap is set, a src row runs down a
+ * dest column; rev says whether the contiguous direction in dest runs
+ * backwards relative to src.
+ */
+typedef struct orient_ctx orient_ctx;
+
+/* Does one leaf piece, in the version for the current ISA level */
+typedef void (*leaf_func)(orient_ctx *c, int i0, int i1, int j0, int j1);
+
+struct orient_ctx {
+  int dim;
+  pixel *src, *dest;
+  long base, di, dj;
+  int swap, rev, gray;
+  leaf_func leaf;
+};
+
+static leaf_func leaf_funcs[ISA_COUNT];
+
+static void init_ctx(orient_ctx *c, int dim, pixel *src, pixel *dest,
+                     orientation o, int gray)
+{
+  long n = dim;
+
+  c->dim = dim;
+  c->src = src;
+  c->dest = dest;
+  c->gray = gray;
+  c->leaf = leaf_funcs[isa_current()];
+
+  switch (o) {
+  case ORIENT_IDENTITY:
+    c->base = 0;             c->di = n;   c->dj = 1;   break;
+  case ORIENT_ROT90:
+    c->base = n - 1;         c->di = -1;  c->dj = n;   break;
+  case ORIENT_ROT180:
+    c->base = n * n - 1;     c->di = -n;  c->dj = -1;  break;
+  case ORIENT_ROT270:
+    c->base = (n - 1) * n;   c->di = 1;   c->dj = -n;  break;
+  case ORIENT_FLIP_H:
+    c->base = n - 1;         c->di = n;   c->dj = -1;  break;
+  case ORIENT_FLIP_V:
+    c->base = (n - 1) * n;   c->di = -n;  c->dj = 1;   break;
+  case ORIENT_TRANSPOSE:
+    c->base = 0;             c->di = 1;   c->dj = n;   break;
+  default:
+  case ORIENT_ANTI_TRANSPOSE:
+    c->base = n * n - 1;     c->di = -1;  c->dj = -n;  break;
+  }
+
+  c->swap = (c->di == 1 || c->di == -1);
+  c->rev = c->swap ? (c->di < 0) : (c->dj < 0);
+}
+
+/* Scalar version of a piece, used for the edges and without SSE4.1 */
+static void scalar_block(orient_ctx *c, int i0, int i1, int j0, int j1)
+{
+  int i, j, gray;
+  pixel *s, *d;
+
+  for (i = i0; i < i1; i++) {
+    s = &c->src[RIDX(i, j0, c->dim)];
+    d = &c->dest[c->base + i * c->di + j0 * c->dj];
+    for (j = j0; j < j1; j++, s++, d += c->dj) {
+      if (c->gray) {
+        gray = ((int)s->red + (int)s->green + (int)s->blue) / 3;
+        d->red = gray;
+        d->green = gray;
+        d->blue = gray;
+      }
+      else
+        *d = *s;
+    }
+  }
+}
+
+/*
+ * sse_tiles - The 8x8 tiles from src (i0,j0) up to (iend,jend), each
+ * done entirely in registers: split (or grayscale) 8 rows, transpose
+ * if rows become columns, reverse if dest runs backwards, and store 8
+ * runs of 8 pixels. Always inlined so every combination of gray, swap
+ * and rev gets its own loop without any tests inside.
+ */
+__attribute__((target("sse4.1"), always_inline))
+static inline void sse_tiles(orient_ctx *c, int i0, int iend, int j0, int jend,
+                             const int gray, const int swap, const int rev)
+{
+  __m128i r[8], g[8], b[8];
+  pixel *d;
+  int i, j, k;
+
+  for (i = i0; i < iend; i += 8)
+    for (j = j0; j < jend; j += 8) {
+      for (k = 0; k < 8; k++) {
+        if (gray)
+          r[k] = sse_gray8(&c->src[RIDX(i + k, j, c->dim)]);
+        else
+          sse_split8(&c->src[RIDX(i + k, j, c->dim)], &r[k], &g[k], &b[k]);
+      }
+
+      if (swap) {
+        sse_transpose8(r);
+        if (!gray) {
+          sse_transpose8(g);
+          sse_transpose8(b);
+        }
+      }
+
+      for (k = 0; k < 8; k++) {
+        // First dest pixel of run k, the lowest address of the 8
+        if (swap)
+          d = &c->dest[c->base + (i + (rev ? 7 : 0)) * c->di + (j + k) * c->dj];
+        else
+          d = &c->dest[c->base + (i + k) * c->di + (j + (rev ? 7 : 0)) * c->dj];
+
+        if (gray)
+          sse_store8(d, rev ? r[k] : sse_reverse8(r[k]));
+        else if (rev)
+          sse_merge8(d, sse_reverse8(r[k]), sse_reverse8(g[k]), sse_reverse8(b[k]));
+        else
+          sse_merge8(d, r[k], g[k], b[k]);
+      }
+    }
+}
+
+/*
+ * sse_leaf - A piece small enough to stay in cache: full 8x8 tiles,
+ * then edges. Compiled once per SIMD level below; the AVX versions run
+ * the same 128-bit tiles with VEX encoding and no SSE/AVX transitions.
+ */
+__attribute__((target("sse4.1"), always_inline))
+static inline void sse_leaf(orient_ctx *c, int i0, int i1, int j0, int j1)
+{
+  int iend = i0 + ((i1 - i0) & ~7);
+  int jend = j0 + ((j1 - j0) & ~7);
+
+  switch (c->gray << 2 | c->swap << 1 | c->rev) {
+  case 0: sse_tiles(c, i0, iend, j0, jend, 0, 0, 0); break;
+  case 1: sse_tiles(c, i0, iend, j0, jend, 0, 0, 1); break;
+  case 2: sse_tiles(c, i0, iend, j0, jend, 0, 1, 0); break;
+  case 3: sse_tiles(c, i0, iend, j0, jend, 0, 1, 1); break;
+  case 4: sse_tiles(c, i0, iend, j0, jend, 1, 0, 0); break;
+  case 5: sse_tiles(c, i0, iend, j0, jend, 1, 0, 1); break;
+  case 6: sse_tiles(c, i0, iend, j0, jend, 1, 1, 0); break;
+  case 7: sse_tiles(c, i0, iend, j0, jend, 1, 1, 1); break;
+  }
+
+  scalar_block(c, i0, iend, jend, j1);
+  scalar_block(c, iend, i1, j0, j1);
+}
+
+__attribute__((target("sse4.1")))
+static void sse41_leaf(orient_ctx *c, int i0, int i1, int j0, int j1)
+{
+  sse_leaf(c, i0, i1, j0, j1);
+}
+
+__attribute__((target("avx2")))
+static void avx2_leaf(orient_ctx *c, int i0, int i1, int j0, int j1)
+{
+  sse_leaf(c, i0, i1, j0, j1);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void avx512_leaf(orient_ctx *c, int i0, int i1, int j0, int j1)
+{
+  sse_leaf(c, i0, i1, j0, j1);
+}
+
+static leaf_func leaf_funcs[ISA_COUNT] = {
+  scalar_block, sse41_leaf, avx2_leaf, avx512_leaf
+};
+
+/*
+ * recurse - Split the longer side of the piece in half until it fits
+ * in a LEAF x LEAF square. Splits land on multiples of 8 so that every
+ * leaf but the last in each direction is made of whole tiles.
+ */
+static void recurse(orient_ctx *c, int i0, int i1, int j0, int j1)
+{
+  int mid;
+
+  if (i1 - i0 <= LEAF && j1 - j0 <= LEAF) {
+    c->leaf(c, i0, i1, j0, j1);
+    return;
+  }
+
+  if (i1 - i0 >= j1 - j0) {
+    mid = i0 + (((i1 - i0) / 2 + 7) & ~7);
+    recurse(c, i0, mid, j0, j1);
+    recurse(c, mid, i1, j0, j1);
+  }
+  else {
+    mid = j0 + (((j1 - j0) / 2 + 7) & ~7);
+    recurse(c, i0, i1, j0, mid);
+    recurse(c, i0, i1, mid, j1);
+  }
+}
+
+void reorient_range(int dim, pixel *src, pixel *dest, orientation o, int gray,
+                    int i0, int i1, int j0, int j1)
+{
+  orient_ctx c;
+
+  init_ctx(&c, dim, src, dest, o, gray);
+  recurse(&c, i0, i1, j0, j1);
+}
+
+void reorient(int dim, pixel *src, pixel *dest, orientation o, int gray)
+{
+  reorient_range(dim, src, dest, o, gray, 0, dim, 0, dim);
+}
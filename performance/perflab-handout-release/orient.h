@@ -0,0 +1,37 @@
+/*
+ * orient.h - Image reorientation engine for the Performance Lab.
+ *
+ * Applies any of the 8 rotations and flips of a square image, with an
+ * optional grayscale step on the way. The image is split recursively
+ * into halves until the pieces are small enough to stay in cache,
+ * whatever the cache sizes and the image dimension are, and those are
+ * done 8x8 pixels at a time in registers.
+ */
+#ifndef _ORIENT_H_
+#define _ORIENT_H_
+
+#include "defs.h"
+
+/* Where src pixel (i,j) ends up in dest */
+typedef enum {
+  ORIENT_IDENTITY,       /* (i, j) */
+  ORIENT_ROT90,          /* (j, dim-1-i), clockwise */
+  ORIENT_ROT180,         /* (dim-1-i, dim-1-j) */
+  ORIENT_ROT270,         /* (dim-1-j, i) */
+  ORIENT_FLIP_H,         /* (i, dim-1-j), mirror left to right */
+  ORIENT_FLIP_V,         /* (dim-1-i, j), mirror top to bottom */
+  ORIENT_TRANSPOSE,      /* (j, i) */
+  ORIENT_ANTI_TRANSPOSE  /* (dim-1-j, dim-1-i), what complex does */
+} orientation;
+
+#define ORIENT_COUNT 8
+
+/* Write src reoriented by o to dest. When gray is set, every dest
+   pixel gets (red + green + blue) / 3 in all three channels. */
+void reorient(int dim, pixel *src, pixel *dest, orientation o, int gray);
+
+/* Same as reorient, but only for src rows [i0, i1) and columns [j0, j1) */
+void reorient_range(int dim, pixel *src, pixel *dest, orientation o, int gray,
+                    int i0, int i1, int j0, int j1);
+
+#endif /* _ORIENT_H_ */
@@ -0,0 +1,115 @@
+/* Hardware performance counters, see perfctr.h */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perfctr.h"
+
+static int fds[PERF_NEVENTS];
+static int opened = 0;  /* perf_open has run */
+
+/* type and config of each event, in perf_event order */
+#define CACHE_EVENT(cache) \
+  ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct {
+  unsigned int type;
+  unsigned long long config;
+  char *name;
+} events[PERF_NEVENTS] = {
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "Cycles" },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "Instructions" },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES, "LLC refs" },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "LLC misses" },
+  { PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D), "L1D misses" },
+  { PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB), "dTLB misses" },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "Br misses" },
+  { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, "Page faults" },
+};
+
+int perf_open(void)
+{
+  struct perf_event_attr attr;
+  int e, n = 0;
+
+  if (opened)
+    perf_close();
+
+  for (e = 0; e < PERF_NEVENTS; e++) {
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[e].type;
+    attr.config = events[e].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    fds[e] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fds[e] >= 0 && events[e].type != PERF_TYPE_SOFTWARE)
+      n++;
+  }
+
+  opened = 1;
+  return n;
+}
+
+void perf_close(void)
+{
+  int e;
+
+  if (!opened)
+    return;
+  for (e = 0; e < PERF_NEVENTS; e++)
+    if (fds[e] >= 0)
+      close(fds[e]);
+  opened = 0;
+}
+
+void perf_start(void)
+{
+  int e;
+
+  if (!opened)
+    return;
+  for (e = 0; e < PERF_NEVENTS; e++)
+    if (fds[e] >= 0) {
+      ioctl(fds[e], PERF_EVENT_IOC_RESET, 0);
+      ioctl(fds[e], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void perf_stop(perf_sample *s)
+{
+  /* The count and how long the event was enabled and actually on a
+     counter, summed over this thread and the threads it started */
+  struct {
+    unsigned long long value, enabled, running;
+  } count;
+  int e;
+
+  for (e = 0; e < PERF_NEVENTS; e++)
+    if (opened && fds[e] >= 0)
+      ioctl(fds[e], PERF_EVENT_IOC_DISABLE, 0);
+
+  /* With more events than counters the kernel time-shares them, so
+     scale each count up to the whole time it was enabled */
+  for (e = 0; e < PERF_NEVENTS; e++) {
+    s->valid[e] = (opened && fds[e] >= 0 &&
+                   read(fds[e], &count, sizeof(count)) == sizeof(count) &&
+                   count.running > 0);
+    s->count[e] = s->valid[e] ?
+      (double)count.value * count.enabled / count.running : 0.0;
+  }
+}
+
+char *perf_name(perf_event e)
+{
+  return events[e].name;
+}
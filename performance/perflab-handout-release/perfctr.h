@@ -0,0 +1,48 @@
+/*
+ * perfctr.h - Hardware performance counters for the Performance Lab,
+ * read with perf_event_open.
+ *
+ * Each event is opened on its own, for user mode only, so an event the
+ * machine or the kernel's perf_event_paranoid setting doesn't allow is
+ * simply left out. When no hardware event can be opened, the driver
+ * falls back to reporting cycles only, even if the software page fault
+ * event opened. The events are inherited by threads started
+ * after perf_open, so when it runs before the first pool_run the pool
+ * workers' part of a parallel kernel is counted too. There are more
+ * events than most PMUs have counters, so the kernel multiplexes them
+ * and the counts are scaled by the fraction of time each one ran.
+ */
+#ifndef _PERFCTR_H_
+#define _PERFCTR_H_
+
+typedef enum {
+  PERF_CYCLES,        /* core cycles, for IPC */
+  PERF_INSTRUCTIONS,
+  PERF_CACHE_REFS,    /* last level cache references */
+  PERF_CACHE_MISSES,  /* last level cache misses */
+  PERF_L1D_MISSES,    /* L1 data cache read misses */
+  PERF_DTLB_MISSES,   /* data TLB read misses */
+  PERF_BRANCH_MISSES,
+  PERF_PAGE_FAULTS,   /* a software event, available almost everywhere */
+  PERF_NEVENTS
+} perf_event;
+
+/* Counts over one measured call; valid[e] is 0 if e isn't available */
+typedef struct {
+  double count[PERF_NEVENTS];
+  int valid[PERF_NEVENTS];
+} perf_sample;
+
+/* Open every event that can be opened. Returns how many of the
+   hardware events could; the software event doesn't count. */
+int perf_open(void);
+void perf_close(void);
+
+/* Zero and start the open events / stop them and read them into s */
+void perf_start(void);
+void perf_stop(perf_sample *s);
+
+/* Short name of event e, for table rows */
+char *perf_name(perf_event e);
+
+#endif /* _PERFCTR_H_ */
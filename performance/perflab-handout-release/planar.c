@@ -0,0 +1,143 @@
+/* Planar images and pixel <-> planar conversions, see planar.h */
+#include <stdio.h>
+#include <stdlib.h>
+#include "defs.h"
+#include "planar.h"
+#include "simd.h"
+#include "isa.h"
+
+#define BSIZE 64  /* cache block size in bytes */
+#define PAGE 4096
+
+/*
+ * planar_alloc - Allocate a dim x dim planar image. Rows are padded to
+ * a whole number of cache blocks, plus one more block when a row would
+ * be a multiple of the page size, so walking down a column doesn't map
+ * every row to the same cache set.
+ */
+planar_image *planar_alloc(int dim)
+{
+  planar_image *img;
+  int per_block = BSIZE / sizeof(unsigned short);
+  size_t bytes;
+
+  if ((img = malloc(sizeof(planar_image))) == NULL) {
+    fprintf(stderr, "Fatal error.  malloc failed in planar_alloc\n");
+    exit(1);
+  }
+
+  img->dim = dim;
+  img->stride = (dim + per_block - 1) / per_block * per_block;
+  if ((img->stride * sizeof(unsigned short)) % PAGE == 0)
+    img->stride += per_block;
+
+  bytes = (size_t)img->stride * (dim > 0 ? dim : 1) * sizeof(unsigned short);
+  if (posix_memalign((void **)&img->red, BSIZE, bytes) ||
+      posix_memalign((void **)&img->green, BSIZE, bytes) ||
+      posix_memalign((void **)&img->blue, BSIZE, bytes)) {
+    fprintf(stderr, "Fatal error.  posix_memalign failed in planar_alloc\n");
+    exit(1);
+  }
+  return img;
+}
+
+void planar_free(planar_image *img)
+{
+  if (img == NULL)
+    return;
+  free(img->red);
+  free(img->green);
+  free(img->blue);
+  free(img);
+}
+
+__attribute__((target("sse4.1")))
+static void planar_from_pixels_sse(pixel *src, planar_image *dst)
+{
+  int i, j, dim = dst->dim;
+  __m128i vr, vg, vb;
+
+  for (i = 0; i < dim; i++) {
+    pixel *s = &src[RIDX(i, 0, dim)];
+    unsigned short *r = &dst->red[PIDX(dst, i, 0)];
+    unsigned short *g = &dst->green[PIDX(dst, i, 0)];
+    unsigned short *b = &dst->blue[PIDX(dst, i, 0)];
+
+    for (j = 0; j + 8 <= dim; j += 8) {
+      sse_split8(&s[j], &vr, &vg, &vb);
+      _mm_storeu_si128((__m128i *)&r[j], vr);
+      _mm_storeu_si128((__m128i *)&g[j], vg);
+      _mm_storeu_si128((__m128i *)&b[j], vb);
+    }
+    for (; j < dim; j++) {
+      r[j] = s[j].red;
+      g[j] = s[j].green;
+      b[j] = s[j].blue;
+    }
+  }
+}
+
+__attribute__((target("sse4.1")))
+static void planar_to_pixels_sse(planar_image *src, pixel *dst)
+{
+  int i, j, dim = src->dim;
+
+  for (i = 0; i < dim; i++) {
+    pixel *d = &dst[RIDX(i, 0, dim)];
+    unsigned short *r = &src->red[PIDX(src, i, 0)];
+    unsigned short *g = &src->green[PIDX(src, i, 0)];
+    unsigned short *b = &src->blue[PIDX(src, i, 0)];
+
+    for (j = 0; j + 8 <= dim; j += 8)
+      sse_merge8(&d[j], _mm_loadu_si128((__m128i *)&r[j]),
+                 _mm_loadu_si128((__m128i *)&g[j]),
+                 _mm_loadu_si128((__m128i *)&b[j]));
+    for (; j < dim; j++) {
+      d[j].red = r[j];
+      d[j].green = g[j];
+      d[j].blue = b[j];
+    }
+  }
+}
+
+/*
+ * planar_from_pixels - Split a dst->dim x dst->dim pixel array into
+ * the planes of dst
+ */
+void planar_from_pixels(pixel *src, planar_image *dst)
+{
+  int i, j, dim = dst->dim;
+
+  if (isa_current() >= ISA_SSE41) {
+    planar_from_pixels_sse(src, dst);
+    return;
+  }
+
+  for (i = 0; i < dim; i++)
+    for (j = 0; j < dim; j++) {
+      dst->red[PIDX(dst, i, j)] = src[RIDX(i, j, dim)].red;
+      dst->green[PIDX(dst, i, j)] = src[RIDX(i, j, dim)].green;
+      dst->blue[PIDX(dst, i, j)] = src[RIDX(i, j, dim)].blue;
+    }
+}
+
+/*
+ * planar_to_pixels - Interleave the planes of src into a src->dim x
+ * src->dim pixel array
+ */
+void planar_to_pixels(planar_image *src, pixel *dst)
+{
+  int i, j, dim = src->dim;
+
+  if (isa_current() >= ISA_SSE41) {
+    planar_to_pixels_sse(src, dst);
+    return;
+  }
+
+  for (i = 0; i < dim; i++)
+    for (j = 0; j < dim; j++) {
+      dst[RIDX(i, j, dim)].red = src->red[PIDX(src, i, j)];
+      dst[RIDX(i, j, dim)].green = src->green[PIDX(src, i, j)];
+      dst[RIDX(i, j, dim)].blue = src->blue[PIDX(src, i, j)];
+    }
+}
@@ -0,0 +1,38 @@
+/*
+ * planar.h - Planar (structure of arrays) images for the Performance Lab.
+ *
+ * A pixel image stores red, green and blue next to each other for every
+ * pixel. A planar image keeps each channel in its own plane instead, so
+ * kernels can load 8 reds, 8 greens and 8 blues with plain vector loads.
+ * Every plane row starts on a BSIZE byte boundary.
+ */
+#ifndef _PLANAR_H_
+#define _PLANAR_H_
+
+#include "defs.h"
+
+typedef struct {
+  int dim;               /* image is dim x dim */
+  int stride;            /* elements from one plane row to the next */
+  unsigned short *red;   /* the three planes, each stride*dim elements */
+  unsigned short *green;
+  unsigned short *blue;
+} planar_image;
+
+/* Index of element (i,j) in a plane of img */
+#define PIDX(img,i,j) ((i)*(img)->stride+(j))
+
+planar_image *planar_alloc(int dim);
+void planar_free(planar_image *img);
+
+/* Conversions between pixel arrays and planar images of the same dim */
+void planar_from_pixels(pixel *src, planar_image *dst);
+void planar_to_pixels(planar_image *src, pixel *dst);
+
+typedef void (*planar_test_func) (planar_image*, planar_image*);
+
+void register_planar_functions(void);
+void add_planar_complex_function(planar_test_func, char*);
+void add_planar_motion_function(planar_test_func, char*);
+
+#endif /* _PLANAR_H_ */
@@ -0,0 +1,150 @@
+/* Persistent worker pool with work stealing, see pool.h */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "pool.h"
+
+/* One thread's share of the tasks of a job. Padded to a cache block
+   so that threads claiming from different shares don't collide. */
+typedef struct {
+  int next;  /* next unclaimed task, bumped atomically */
+  int end;   /* one past the last task of this share */
+  char pad[64 - 2*sizeof(int)];
+} share_t;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t work_done = PTHREAD_COND_INITIALIZER;
+
+static int threads = 0;     /* threads used per job, 0 = not set yet */
+static int started = 0;     /* worker threads started so far */
+static int generation = 0;  /* bumped for every job handed to workers */
+static int pending = 0;     /* workers that haven't finished the job */
+static int born[POOL_MAX_THREADS]; /* generation each worker started at */
+
+static pool_task_func job_func;
+static void *job_arg;
+static int job_threads;
+static share_t shares[POOL_MAX_THREADS];
+
+/* CPUs for new workers, set by pool_keep_affinity */
+static cpu_set_t worker_cpus;
+static int keep_cpus = 0;
+
+/* Run tasks from our own share, then steal from everyone else's */
+static void work(int self)
+{
+  int i, v, task;
+
+  for (i = 0; i < job_threads; i++) {
+    v = (self + i) % job_threads;
+    while ((task = __atomic_fetch_add(&shares[v].next, 1, __ATOMIC_RELAXED))
+           < shares[v].end)
+      job_func(job_arg, task);
+  }
+}
+
+static void *worker(void *vargp)
+{
+  int self = (int)(long)vargp;
+  int seen = born[self];
+
+  for (;;) {
+    pthread_mutex_lock(&lock);
+    while (generation == seen)
+      pthread_cond_wait(&work_ready, &lock);
+    seen = generation;
+    pthread_mutex_unlock(&lock);
+
+    if (self < job_threads)
+      work(self);
+
+    pthread_mutex_lock(&lock);
+    if (--pending == 0)
+      pthread_cond_signal(&work_done);
+    pthread_mutex_unlock(&lock);
+  }
+  return NULL;
+}
+
+int pool_threads(void)
+{
+  if (threads == 0) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = (n < 1) ? 1 : (n > POOL_MAX_THREADS) ? POOL_MAX_THREADS : n;
+  }
+  return threads;
+}
+
+void pool_set_threads(int n)
+{
+  threads = (n < 1) ? 1 : (n > POOL_MAX_THREADS) ? POOL_MAX_THREADS : n;
+}
+
+void pool_keep_affinity(void)
+{
+  if (pthread_getaffinity_np(pthread_self(), sizeof(worker_cpus), &worker_cpus) == 0)
+    keep_cpus = 1;
+}
+
+void pool_run(pool_task_func f, void *arg, int ntasks)
+{
+  pool_run_threads(f, arg, ntasks, pool_threads());
+}
+
+void pool_run_threads(pool_task_func f, void *arg, int ntasks, int nthreads)
+{
+  int i, n = (nthreads > POOL_MAX_THREADS) ? POOL_MAX_THREADS : nthreads;
+  pthread_t tid;
+  pthread_attr_t attr;
+
+  if (n > ntasks)
+    n = ntasks;
+  if (n <= 1) {
+    for (i = 0; i < ntasks; i++)
+      f(arg, i);
+    return;
+  }
+
+  /* Workers 1..n-1 run on their own threads, the caller is worker 0.
+     Without pool_keep_affinity they inherit the caller's CPUs. A new
+     worker waits for the job after the current generation, else it
+     would take the last job as its own and finish the next one twice. */
+  pthread_attr_init(&attr);
+  if (keep_cpus)
+    pthread_attr_setaffinity_np(&attr, sizeof(worker_cpus), &worker_cpus);
+  while (started < n - 1) {
+    born[started + 1] = generation;
+    if (pthread_create(&tid, &attr, worker, (void *)(long)(started + 1)) != 0) {
+      fprintf(stderr, "Fatal error.  pthread_create failed in pool_run\n");
+      exit(1);
+    }
+    pthread_detach(tid);
+    started++;
+  }
+  pthread_attr_destroy(&attr);
+
+  pthread_mutex_lock(&lock);
+  job_func = f;
+  job_arg = arg;
+  job_threads = n;
+  for (i = 0; i < n; i++) {
+    shares[i].next = (int)((long)ntasks * i / n);
+    shares[i].end = (int)((long)ntasks * (i + 1) / n);
+  }
+  pending = started;
+  generation++;
+  pthread_cond_broadcast(&work_ready);
+  pthread_mutex_unlock(&lock);
+
+  work(0);
+
+  pthread_mutex_lock(&lock);
+  while (pending > 0)
+    pthread_cond_wait(&work_done, &lock);
+  pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,35 @@
+/*
+ * pool.h - Persistent worker pool for running image kernels on
+ * several cores.
+ *
+ * A job is split into ntasks independent tasks (row bands or tiles).
+ * Each thread starts on its own contiguous share of the tasks and,
+ * once that runs dry, steals tasks from the other shares.
+ */
+#ifndef _POOL_H_
+#define _POOL_H_
+
+typedef void (*pool_task_func)(void *arg, int task);
+
+/* Run f(arg, t) for every t in [0, ntasks) and wait for all of them.
+   The calling thread works on the job too. */
+void pool_run(pool_task_func f, void *arg, int ntasks);
+
+/* Same as pool_run, but with nthreads threads instead of pool_threads() */
+void pool_run_threads(pool_task_func f, void *arg, int ntasks, int nthreads);
+
+/* Set the number of threads used by pool_run (including the caller).
+   Default = number of online processors */
+void pool_set_threads(int n);
+
+/* Number of threads used by pool_run */
+int pool_threads(void);
+
+/* Start the workers of later jobs on the CPUs the calling thread may
+   run on now, so that pinning the caller afterwards doesn't pin them */
+void pool_keep_affinity(void);
+
+/* Maximum number of threads the pool will start */
+#define POOL_MAX_THREADS 64
+
+#endif /* _POOL_H_ */
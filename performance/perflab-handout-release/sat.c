@@ -0,0 +1,198 @@
+/* Summed-area tables, see sat.h */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "defs.h"
+#include "sat.h"
+#include "pool.h"
+#include "isa.h"
+
+/* Rows per task when building and querying, and table entries (times
+   3 channels) per column strip when summing down the columns */
+#define SAT_BAND 16
+#define SAT_STRIP 768
+
+/*
+ * Exact n / d for n <= 65535 * d and d <= 65536, as (n * m) >> 48 with
+ * m = 2^48 / d + 1: the error n * (m - 2^48 / d) / 2^48 is under 1 / d
+ * since 65535 * d * d < 2^48, and n * m stays below 2^64.
+ */
+#define RECIP_SHIFT 48
+
+static inline unsigned long long recip(unsigned d)
+{
+  return (1ULL << RECIP_SHIFT) / d + 1;
+}
+
+sat_table *sat_alloc(int rows, int cols)
+{
+  sat_table *t = malloc(sizeof(sat_table));
+
+  if (t != NULL)
+    t->sum = malloc(3 * sizeof(unsigned) * (rows + 1L) * (cols + 1L));
+  if (t == NULL || t->sum == NULL) {
+    fprintf(stderr, "Fatal error.  malloc failed in sat_alloc\n");
+    exit(1);
+  }
+  t->rows = rows;
+  t->cols = cols;
+  return t;
+}
+
+void sat_free(sat_table *t)
+{
+  free(t->sum);
+  free(t);
+}
+
+typedef struct {
+  sat_table *t;
+  unsigned short *img;  /* the image as a flat channel array */
+  int k;
+} sat_args;
+
+/* Pass 1: prefix sums along each image row into table rows i+1 */
+static inline __attribute__((always_inline))
+void row_sums_body(sat_table *t, unsigned short *src, int i0, int i1)
+{
+  int i;
+  long e, n = 3L * t->cols;
+  unsigned *row;
+  unsigned short *s;
+
+  for (i = i0; i < i1; i++) {
+    row = &t->sum[SAT_IDX(t, i + 1, 0)];
+    s = &src[i * n];
+    row[0] = row[1] = row[2] = 0;
+    for (e = 0; e < n; e++)
+      row[e + 3] = row[e] + s[e];
+  }
+}
+
+ISA_CLONES(row_sums, (sat_table *t, unsigned short *src, int i0, int i1),
+           (t, src, i0, i1));
+
+static void row_sums_task(void *vargs, int task)
+{
+  sat_args *a = (sat_args *)vargs;
+  int i0 = task * SAT_BAND;
+  int i1 = (i0 + SAT_BAND < a->t->rows) ? i0 + SAT_BAND : a->t->rows;
+
+  row_sums_clones[isa_current()](a->t, a->img, i0, i1);
+}
+
+/* Pass 2: add each table row into the next, one column strip per task */
+static inline __attribute__((always_inline))
+void column_sums_body(sat_table *t, long e0, long e1)
+{
+  int i;
+  long e, width = 3L * (t->cols + 1);
+  unsigned *above, *row;
+
+  for (e = e0; e < e1; e++)
+    t->sum[e] = 0;
+  for (i = 2; i <= t->rows; i++) {
+    above = &t->sum[(i - 1) * width];
+    row = &t->sum[i * width];
+    for (e = e0; e < e1; e++)
+      row[e] += above[e];
+  }
+}
+
+ISA_CLONES(column_sums, (sat_table *t, long e0, long e1), (t, e0, e1));
+
+static void column_sums_task(void *vargs, int task)
+{
+  sat_args *a = (sat_args *)vargs;
+  long width = 3L * (a->t->cols + 1);
+  long e0 = (long)task * SAT_STRIP;
+  long e1 = (e0 + SAT_STRIP < width) ? e0 + SAT_STRIP : width;
+
+  column_sums_clones[isa_current()](a->t, e0, e1);
+}
+
+void sat_build(sat_table *t, pixel *src)
+{
+  sat_args args = { t, (unsigned short *)src, 0 };
+  long width = 3L * (t->cols + 1);
+
+  pool_run(row_sums_task, &args, (t->rows + SAT_BAND - 1) / SAT_BAND);
+  pool_run(column_sums_task, &args, (int)((width + SAT_STRIP - 1) / SAT_STRIP));
+}
+
+/*
+ * box_rows_body - Output rows [i0, i1). Window (i,j) covers table rows
+ * i to i2 = i + h and columns j to j + w, h and w cut down to what is
+ * left of the image. Away from the right edge w = k, so the row is
+ * one flat loop over channels with a single reciprocal.
+ */
+static inline __attribute__((always_inline))
+void box_rows_body(sat_table *t, unsigned short *dst, int k, int i0, int i1)
+{
+  int i, j, h, w;
+  long e, full, n = 3L * t->cols;
+  unsigned *top, *bottom, sum;
+  unsigned long long m;
+  unsigned short *out;
+
+  for (i = i0; i < i1; i++) {
+    h = (k < t->rows - i) ? k : t->rows - i;
+    top = &t->sum[SAT_IDX(t, i, 0)];
+    bottom = &t->sum[SAT_IDX(t, i + h, 0)];
+    out = &dst[i * n];
+
+    full = 3L * (t->cols - k + 1);
+    m = recip(h * k);
+    for (e = 0; e < full; e++) {
+      sum = bottom[e + 3 * k] - top[e + 3 * k] - bottom[e] + top[e];
+      out[e] = (sum * m) >> RECIP_SHIFT;
+    }
+
+    // Right edge, where the window gets narrower
+    for (j = (full > 0) ? t->cols - k + 1 : 0; j < t->cols; j++) {
+      w = t->cols - j;
+      m = recip(h * w);
+      for (e = 3L * j; e < 3L * j + 3; e++) {
+        sum = bottom[e + 3 * w] - top[e + 3 * w] - bottom[e] + top[e];
+        out[e] = (sum * m) >> RECIP_SHIFT;
+      }
+    }
+  }
+}
+
+ISA_CLONES(box_rows, (sat_table *t, unsigned short *dst, int k, int i0, int i1),
+           (t, dst, k, i0, i1));
+
+static void box_rows_task(void *vargs, int task)
+{
+  sat_args *a = (sat_args *)vargs;
+  int i0 = task * SAT_BAND;
+  int i1 = (i0 + SAT_BAND < a->t->rows) ? i0 + SAT_BAND : a->t->rows;
+
+  box_rows_clones[isa_current()](a->t, a->img, a->k, i0, i1);
+}
+
+void sat_box(sat_table *t, pixel *dst, int k)
+{
+  sat_args args = { t, (unsigned short *)dst, k };
+
+  if (k < 1 || k > SAT_MAX_K) {
+    fprintf(stderr, "Fatal error.  box size %d is not between 1 and %d\n",
+            k, SAT_MAX_K);
+    exit(1);
+  }
+  pool_run(box_rows_task, &args, (t->rows + SAT_BAND - 1) / SAT_BAND);
+}
+
+void box_motion(int dim, pixel *src, pixel *dst, int k)
+{
+  static sat_table *t = NULL;
+
+  if (t == NULL || t->rows != dim || t->cols != dim) {
+    if (t != NULL)
+      sat_free(t);
+    t = sat_alloc(dim, dim);
+  }
+  sat_build(t, src);
+  sat_box(t, dst, k);
+}
@@ -0,0 +1,45 @@
+/*
+ * sat.h - Summed-area tables (integral images) and box averages of
+ * any size for the Performance Lab.
+ *
+ * Entry (i,j) of the table for a rows x cols image holds, for each
+ * channel, the sum of the pixels above and to the left of (i,j): rows
+ * [0, i) and columns [0, j). Any rectangle sum is then 4 lookups, so a
+ * K x K box average costs the same for every K. box_motion is motion
+ * with a K x K window instead of 3x3, cut off at the bottom and right
+ * edges and averaged over what is left, just like weighted_combo.
+ *
+ * Entries are 32 bit, widened from the 16 bit channels, and wrap
+ * around on large images. Rectangle sums are differences, which come
+ * out exact modulo 2^32, and a K x K sum is below 65535 * K * K <
+ * 2^32 as long as K <= SAT_MAX_K, so the results are exact anyway.
+ */
+#ifndef _SAT_H_
+#define _SAT_H_
+
+#include "defs.h"
+
+#define SAT_MAX_K 256
+
+typedef struct {
+  int rows, cols;   /* size of the image, the table is one more each way */
+  unsigned *sum;    /* 3 channel sums per entry, row major */
+} sat_table;
+
+/* Index of the red sum of entry (i,j) */
+#define SAT_IDX(t,i,j) (3L * ((long)(i) * ((t)->cols + 1) + (j)))
+
+sat_table *sat_alloc(int rows, int cols);
+void sat_free(sat_table *t);
+
+/* Fill t from a t->rows x t->cols image, on the worker pool */
+void sat_build(sat_table *t, pixel *src);
+
+/* dst = the k x k box average of t's image, on the worker pool */
+void sat_box(sat_table *t, pixel *dst, int k);
+
+/* box_motion - sat_build then sat_box for a dim x dim image. The table
+   is kept between calls. box_motion(dim, src, dst, 3) is motion. */
+void box_motion(int dim, pixel *src, pixel *dst, int k);
+
+#endif /* _SAT_H_ */
@@ -0,0 +1,178 @@
+/*
+ * simd.h - SSE4.1 building blocks shared by the vectorized kernels.
+ *
+ * Everything here is compiled for SSE4.1 with a target attribute, so
+ * callers must be SSE4.1 functions themselves and must only be called
+ * when isa_current() >= ISA_SSE41 (see isa.h).
+ */
+#ifndef _SIMD_H_
+#define _SIMD_H_
+
+#include <immintrin.h>
+#include "defs.h"
+
+#define SIMD_INLINE __attribute__((target("sse4.1"))) static inline
+
+/*
+ * sse_gray - Returns (r + g + b) / 3 for 8 unsigned shorts per channel.
+ * The channels are summed in 32 bits and divided by 3 with a
+ * multiply-high by the reciprocal 0xAAAAAAAB.
+ */
+SIMD_INLINE __m128i sse_gray(__m128i r, __m128i g, __m128i b)
+{
+  const __m128i recip = _mm_set1_epi32(0xAAAAAAAB);
+  const __m128i zero = _mm_setzero_si128();
+  __m128i lo, hi, even, odd;
+
+  // Widen to 32 bits, the sum can be up to 3 * 65535
+  lo = _mm_add_epi32(_mm_add_epi32(_mm_unpacklo_epi16(r, zero), _mm_unpacklo_epi16(g, zero)),
+                     _mm_unpacklo_epi16(b, zero));
+  hi = _mm_add_epi32(_mm_add_epi32(_mm_unpackhi_epi16(r, zero), _mm_unpackhi_epi16(g, zero)),
+                     _mm_unpackhi_epi16(b, zero));
+
+  // x / 3 == (x * 0xAAAAAAAB) >> 33 for every 32 bit x
+  even = _mm_srli_epi64(_mm_mul_epu32(lo, recip), 33);
+  odd = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(lo, 32), recip), 33);
+  lo = _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+  even = _mm_srli_epi64(_mm_mul_epu32(hi, recip), 33);
+  odd = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(hi, 32), recip), 33);
+  hi = _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+
+  return _mm_packus_epi32(lo, hi);
+}
+
+/*
+ * sse_split8 - Loads the 8 pixels at p and splits the 48 bytes of
+ * interleaved channels into 8 reds, 8 greens and 8 blues
+ */
+SIMD_INLINE void sse_split8(pixel *p, __m128i *r, __m128i *g, __m128i *b)
+{
+  const __m128i r0 = _mm_setr_epi8(0, 1, 6, 7, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i r1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 3, 8, 9, 14, 15, -1, -1, -1, -1);
+  const __m128i r2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 4, 5, 10, 11);
+  const __m128i g0 = _mm_setr_epi8(2, 3, 8, 9, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i g1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 4, 5, 10, 11, -1, -1, -1, -1, -1, -1);
+  const __m128i g2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 1, 6, 7, 12, 13);
+  const __m128i b0 = _mm_setr_epi8(4, 5, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i b1 = _mm_setr_epi8(-1, -1, -1, -1, 0, 1, 6, 7, 12, 13, -1, -1, -1, -1, -1, -1);
+  const __m128i b2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 3, 8, 9, 14, 15);
+  __m128i x = _mm_loadu_si128((__m128i *)p);
+  __m128i y = _mm_loadu_si128((__m128i *)p + 1);
+  __m128i z = _mm_loadu_si128((__m128i *)p + 2);
+
+  *r = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(x, r0), _mm_shuffle_epi8(y, r1)), _mm_shuffle_epi8(z, r2));
+  *g = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(x, g0), _mm_shuffle_epi8(y, g1)), _mm_shuffle_epi8(z, g2));
+  *b = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(x, b0), _mm_shuffle_epi8(y, b1)), _mm_shuffle_epi8(z, b2));
+}
+
+/*
+ * sse_merge8 - Interleaves 8 reds, 8 greens and 8 blues into the 8
+ * pixels at p
+ */
+SIMD_INLINE void sse_merge8(pixel *p, __m128i r, __m128i g, __m128i b)
+{
+  const __m128i r0 = _mm_setr_epi8(0, 1, -1, -1, -1, -1, 2, 3, -1, -1, -1, -1, 4, 5, -1, -1);
+  const __m128i g0 = _mm_setr_epi8(-1, -1, 0, 1, -1, -1, -1, -1, 2, 3, -1, -1, -1, -1, 4, 5);
+  const __m128i b0 = _mm_setr_epi8(-1, -1, -1, -1, 0, 1, -1, -1, -1, -1, 2, 3, -1, -1, -1, -1);
+  const __m128i r1 = _mm_setr_epi8(-1, -1, 6, 7, -1, -1, -1, -1, 8, 9, -1, -1, -1, -1, 10, 11);
+  const __m128i g1 = _mm_setr_epi8(-1, -1, -1, -1, 6, 7, -1, -1, -1, -1, 8, 9, -1, -1, -1, -1);
+  const __m128i b1 = _mm_setr_epi8(4, 5, -1, -1, -1, -1, 6, 7, -1, -1, -1, -1, 8, 9, -1, -1);
+  const __m128i r2 = _mm_setr_epi8(-1, -1, -1, -1, 12, 13, -1, -1, -1, -1, 14, 15, -1, -1, -1, -1);
+  const __m128i g2 = _mm_setr_epi8(10, 11, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1, 14, 15, -1, -1);
+  const __m128i b2 = _mm_setr_epi8(-1, -1, 10, 11, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1, 14, 15);
+
+  _mm_storeu_si128((__m128i *)p, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r0),
+                   _mm_shuffle_epi8(g, g0)), _mm_shuffle_epi8(b, b0)));
+  _mm_storeu_si128((__m128i *)p + 1, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r1),
+                   _mm_shuffle_epi8(g, g1)), _mm_shuffle_epi8(b, b1)));
+  _mm_storeu_si128((__m128i *)p + 2, _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, r2),
+                   _mm_shuffle_epi8(g, g2)), _mm_shuffle_epi8(b, b2)));
+}
+
+/*
+ * sse_gray8 - Loads the 8 pixels at p and returns their grayscale
+ * values as 8 unsigned shorts
+ */
+SIMD_INLINE __m128i sse_gray8(pixel *p)
+{
+  __m128i r, g, b;
+
+  sse_split8(p, &r, &g, &b);
+  return sse_gray(r, g, b);
+}
+
+/*
+ * sse_reverse8 - Reverses the order of 8 unsigned shorts
+ */
+SIMD_INLINE __m128i sse_reverse8(__m128i v)
+{
+  const __m128i reverse = _mm_setr_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+
+  return _mm_shuffle_epi8(v, reverse);
+}
+
+/*
+ * sse_transpose8 - Transposes the 8x8 tile of unsigned shorts held in
+ * row[0..7]. On return, row[k] holds column k of the original tile.
+ */
+SIMD_INLINE void sse_transpose8(__m128i *row)
+{
+  __m128i t[8], u[8];
+  int k;
+
+  t[0] = _mm_unpacklo_epi16(row[0], row[1]);
+  t[1] = _mm_unpackhi_epi16(row[0], row[1]);
+  t[2] = _mm_unpacklo_epi16(row[2], row[3]);
+  t[3] = _mm_unpackhi_epi16(row[2], row[3]);
+  t[4] = _mm_unpacklo_epi16(row[4], row[5]);
+  t[5] = _mm_unpackhi_epi16(row[4], row[5]);
+  t[6] = _mm_unpacklo_epi16(row[6], row[7]);
+  t[7] = _mm_unpackhi_epi16(row[6], row[7]);
+
+  u[0] = _mm_unpacklo_epi32(t[0], t[2]);
+  u[1] = _mm_unpackhi_epi32(t[0], t[2]);
+  u[2] = _mm_unpacklo_epi32(t[1], t[3]);
+  u[3] = _mm_unpackhi_epi32(t[1], t[3]);
+  u[4] = _mm_unpacklo_epi32(t[4], t[6]);
+  u[5] = _mm_unpackhi_epi32(t[4], t[6]);
+  u[6] = _mm_unpacklo_epi32(t[5], t[7]);
+  u[7] = _mm_unpackhi_epi32(t[5], t[7]);
+
+  for (k = 0; k < 4; k++)
+  {
+    row[2 * k] = _mm_unpacklo_epi64(u[k], u[k + 4]);
+    row[2 * k + 1] = _mm_unpackhi_epi64(u[k], u[k + 4]);
+  }
+}
+
+/*
+ * sse_store8 - Writes the 8 gray values in v to the 8 pixels at p in
+ * reverse order, repeating each value in all three channels
+ */
+SIMD_INLINE void sse_store8(pixel *p, __m128i v)
+{
+  const __m128i e0 = _mm_setr_epi8(14, 15, 14, 15, 14, 15, 12, 13, 12, 13, 12, 13, 10, 11, 10, 11);
+  const __m128i e1 = _mm_setr_epi8(10, 11, 8, 9, 8, 9, 8, 9, 6, 7, 6, 7, 6, 7, 4, 5);
+  const __m128i e2 = _mm_setr_epi8(4, 5, 4, 5, 2, 3, 2, 3, 2, 3, 0, 1, 0, 1, 0, 1);
+
+  _mm_storeu_si128((__m128i *)p, _mm_shuffle_epi8(v, e0));
+  _mm_storeu_si128((__m128i *)p + 1, _mm_shuffle_epi8(v, e1));
+  _mm_storeu_si128((__m128i *)p + 2, _mm_shuffle_epi8(v, e2));
+}
+
+/*
+ * sse_stream8 - sse_store8 with non-temporal stores, which go around
+ * the caches and don't read the line first. p must be 16 byte aligned.
+ */
+SIMD_INLINE void sse_stream8(pixel *p, __m128i v)
+{
+  const __m128i e0 = _mm_setr_epi8(14, 15, 14, 15, 14, 15, 12, 13, 12, 13, 12, 13, 10, 11, 10, 11);
+  const __m128i e1 = _mm_setr_epi8(10, 11, 8, 9, 8, 9, 8, 9, 6, 7, 6, 7, 6, 7, 4, 5);
+  const __m128i e2 = _mm_setr_epi8(4, 5, 4, 5, 2, 3, 2, 3, 2, 3, 0, 1, 0, 1, 0, 1);
+
+  _mm_stream_si128((__m128i *)p, _mm_shuffle_epi8(v, e0));
+  _mm_stream_si128((__m128i *)p + 1, _mm_shuffle_epi8(v, e1));
+  _mm_stream_si128((__m128i *)p + 2, _mm_shuffle_epi8(v, e2));
+}
+
+#endif /* _SIMD_H_ */
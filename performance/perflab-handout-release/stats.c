@@ -0,0 +1,250 @@
+/* Repeated measurements and baselines, see stats.h */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "stats.h"
+
+static int cmp_double(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return (x > y) - (x < y);
+}
+
+/* Quantile q of the n sorted values x, interpolated between neighbors */
+static double quantile(double *x, int n, double q)
+{
+  double pos = q * (n - 1);
+  int i = (int)pos;
+
+  if (i >= n - 1)
+    return x[n - 1];
+  return x[i] + (pos - i) * (x[i + 1] - x[i]);
+}
+
+void stats_summarize(double *x, int n, stats_summary *s)
+{
+  double *sorted = malloc(n * sizeof(double));
+  double half = 0.98 * sqrt(n);  /* 1.96 standard deviations of the rank */
+  int lo, hi;
+
+  if (sorted == NULL) {
+    fprintf(stderr, "Fatal error.  malloc failed in stats_summarize\n");
+    exit(1);
+  }
+  memcpy(sorted, x, n * sizeof(double));
+  qsort(sorted, n, sizeof(double), cmp_double);
+
+  s->median = quantile(sorted, n, 0.5);
+  s->q1 = quantile(sorted, n, 0.25);
+  s->q3 = quantile(sorted, n, 0.75);
+
+  // The median lies between these order statistics (1 based ranks)
+  // with about 95% probability, whatever the distribution
+  lo = (int)floor(n / 2.0 - half);
+  hi = (int)ceil(n / 2.0 + 1 + half);
+  s->ci_lo = sorted[(lo < 1 ? 1 : lo) - 1];
+  s->ci_hi = sorted[(hi > n ? n : hi) - 1];
+  free(sorted);
+}
+
+typedef struct {
+  double value;
+  int from_x;
+} ranked;
+
+static int cmp_ranked(const void *a, const void *b)
+{
+  return cmp_double(&((const ranked *)a)->value, &((const ranked *)b)->value);
+}
+
+double stats_mann_whitney(double *x, int nx, double *y, int ny)
+{
+  int n = nx + ny, i, j, k;
+  ranked *all = malloc(n * sizeof(ranked));
+  double rank_x = 0.0, ties = 0.0, t, u, mu, sigma, z;
+
+  if (all == NULL) {
+    fprintf(stderr, "Fatal error.  malloc failed in stats_mann_whitney\n");
+    exit(1);
+  }
+  for (i = 0; i < nx; i++) {
+    all[i].value = x[i];
+    all[i].from_x = 1;
+  }
+  for (i = 0; i < ny; i++) {
+    all[nx + i].value = y[i];
+    all[nx + i].from_x = 0;
+  }
+  qsort(all, n, sizeof(ranked), cmp_ranked);
+
+  // Tied values share the average of their ranks
+  for (i = 0; i < n; i = j) {
+    for (j = i + 1; j < n && all[j].value == all[i].value; j++)
+      ;
+    t = j - i;
+    ties += t * t * t - t;
+    for (k = i; k < j; k++)
+      if (all[k].from_x)
+        rank_x += (i + 1 + j) / 2.0;
+  }
+  free(all);
+
+  u = rank_x - nx * (nx + 1) / 2.0;
+  mu = nx * (double)ny / 2.0;
+  sigma = sqrt(nx * (double)ny / 12.0 * ((n + 1) - ties / ((double)n * (n - 1))));
+  if (sigma <= 0.0)
+    return 1.0;
+  z = (fabs(u - mu) - 0.5) / sigma;
+  if (z < 0.0)
+    z = 0.0;
+  return erfc(z / sqrt(2.0));
+}
+
+/* The p-value of stats_mann_whitney for nx samples all below ny
+   others, the smallest it can return for those counts */
+static double min_p(int nx, int ny)
+{
+  double mu = nx * (double)ny / 2.0;
+  double sigma = sqrt(nx * (double)ny / 12.0 * (nx + ny + 1));
+
+  return erfc((mu - 0.5) / sigma / sqrt(2.0));
+}
+
+stats_verdict stats_compare(stats_result *r, stats_result *b, double *p)
+{
+  stats_summary now, then;
+
+  stats_summarize(r->sample, r->n, &now);
+  stats_summarize(b->sample, b->n, &then);
+  *p = stats_mann_whitney(r->sample, r->n, b->sample, b->n);
+  if (min_p(r->n, b->n) >= STATS_ALPHA)
+    return STATS_TOO_FEW;
+  if (*p >= STATS_ALPHA)
+    return STATS_SAME;
+  if (now.median > then.median * (1.0 + STATS_MIN_CHANGE))
+    return STATS_SLOWER;
+  if (now.median < then.median * (1.0 - STATS_MIN_CHANGE))
+    return STATS_FASTER;
+  return STATS_SAME;
+}
+
+/* Write s as a JSON string */
+static void put_string(FILE *f, char *s)
+{
+  putc('"', f);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\')
+      putc('\\', f);
+    putc(*s, f);
+  }
+  putc('"', f);
+}
+
+int stats_save(char *file, stats_result *r, int n)
+{
+  FILE *f = fopen(file, "w");
+  int i, k;
+
+  if (f == NULL)
+    return -1;
+  fprintf(f, "{\n  \"results\": [\n");
+  for (i = 0; i < n; i++) {
+    fprintf(f, "    {\"kind\": ");
+    put_string(f, r[i].kind);
+    fprintf(f, ", \"version\": ");
+    put_string(f, r[i].version);
+    fprintf(f, ", \"dim\": %d, \"samples\": [", r[i].dim);
+    for (k = 0; k < r[i].n; k++)
+      fprintf(f, "%s%.4f", k ? ", " : "", r[i].sample[k]);
+    fprintf(f, "]}%s\n", (i < n - 1) ? "," : "");
+  }
+  fprintf(f, "  ]\n}\n");
+  fclose(f);
+  return n;
+}
+
+/* Read the JSON string value of key in line into out; 0 if it isn't there */
+static int get_string(char *line, char *key, char *out, int size)
+{
+  char *p = strstr(line, key);
+  int len = 0;
+
+  if (p == NULL || (p = strchr(p + strlen(key), '"')) == NULL)
+    return 0;
+  for (p++; *p && *p != '"'; p++) {
+    if (*p == '\\' && p[1])
+      p++;
+    if (len < size - 1)
+      out[len++] = *p;
+  }
+  out[len] = '\0';
+  return 1;
+}
+
+int stats_load(char *file, stats_result *r, int max)
+{
+  FILE *f = fopen(file, "r");
+  char line[8192], *p, *end;
+  int n = 0;
+
+  if (f == NULL)
+    return -1;
+
+  // stats_save writes one result per line
+  while (n < max && fgets(line, sizeof(line), f) != NULL) {
+    if (!get_string(line, "\"kind\":", r[n].kind, sizeof(r[n].kind)) ||
+        !get_string(line, "\"version\":", r[n].version, sizeof(r[n].version)) ||
+        (p = strstr(line, "\"dim\":")) == NULL ||
+        (r[n].dim = atoi(p + 6)) <= 0 ||
+        (p = strstr(line, "\"samples\":")) == NULL ||
+        (p = strchr(p, '[')) == NULL)
+      continue;
+    r[n].n = 0;
+    for (p++; r[n].n < STATS_MAX_SAMPLES; p = end + 1) {
+      r[n].sample[r[n].n] = strtod(p, &end);
+      if (end == p)
+        break;
+      r[n].n++;
+      while (*end == ' ')
+        end++;
+      if (*end != ',')
+        break;
+    }
+    if (r[n].n > 0)
+      n++;
+  }
+  fclose(f);
+  return n;
+}
+
+stats_result *stats_find(stats_result *r, int n, char *kind,
+                         char *version, int dim)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    if (r[i].dim == dim && strcmp(r[i].kind, kind) == 0 &&
+        strcmp(r[i].version, version) == 0)
+      return &r[i];
+  return NULL;
+}
+
+int stats_pin(void)
+{
+  cpu_set_t set;
+  int cpu = sched_getcpu();
+
+  if (cpu < 0)
+    return -1;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    return -1;
+  return cpu;
+}
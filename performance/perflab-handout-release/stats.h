@@ -0,0 +1,67 @@
+/*
+ * stats.h - Repeated measurements, baseline files and regression
+ * tests for the Performance Lab.
+ *
+ * One k-best CPE (see fcyc.h) still moves from run to run, so a
+ * version is measured n times and summarized by its median and
+ * quartiles, with a distribution free 95% confidence interval for the
+ * median from the order statistics. Baseline files keep every sample
+ * as JSON, one result per line. A new run is compared with a baseline
+ * by the two sided Mann-Whitney U test, and only a change that is both
+ * significant (p < STATS_ALPHA) and larger than STATS_MIN_CHANGE of the
+ * baseline median counts as a regression or an improvement.
+ */
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#define STATS_MAX_SAMPLES 256
+#define STATS_ALPHA 0.01
+#define STATS_MIN_CHANGE 0.03
+
+/* Fewest samples per side that can reach STATS_ALPHA at all: two fully
+   separated sets of 6 give p = 0.005, two sets of 5 only p = 0.012 */
+#define STATS_MIN_SAMPLES 6
+
+/* The samples of one version at one dim */
+typedef struct {
+  char kind[16];         /* "complex" or "motion" */
+  char version[256];     /* benchmark description */
+  int dim;
+  int n;
+  double sample[STATS_MAX_SAMPLES];  /* CPEs */
+} stats_result;
+
+typedef struct {
+  double median, q1, q3;   /* quartiles */
+  double ci_lo, ci_hi;     /* 95% confidence interval of the median */
+} stats_summary;
+
+/* Summarize the n samples of x (n >= 1) */
+void stats_summarize(double *x, int n, stats_summary *s);
+
+/* Two sided p-value of the Mann-Whitney U test of x against y, with
+   the normal approximation and the correction for ties */
+double stats_mann_whitney(double *x, int nx, double *y, int ny);
+
+/* Verdicts of stats_compare. STATS_TOO_FEW means the two sample
+   counts can't reach STATS_ALPHA however far apart the samples are. */
+typedef enum { STATS_SAME, STATS_SLOWER, STATS_FASTER, STATS_TOO_FEW } stats_verdict;
+
+/* Compare the CPEs r against the baseline b; *p gets the p-value */
+stats_verdict stats_compare(stats_result *r, stats_result *b, double *p);
+
+/* Write n results to / read up to max results from a baseline file.
+   Return the number of results, or -1 if the file can't be opened. */
+int stats_save(char *file, stats_result *r, int n);
+int stats_load(char *file, stats_result *r, int max);
+
+/* The result in r[0..n) for kind, version and dim, or NULL */
+stats_result *stats_find(stats_result *r, int n, char *kind,
+                         char *version, int dim);
+
+/* Pin the calling thread to the CPU it is running on. Threads it
+   creates afterwards inherit the pin (see pool_keep_affinity).
+   Returns the CPU, or -1 if it can't be pinned. */
+int stats_pin(void);
+
+#endif /* _STATS_H_ */
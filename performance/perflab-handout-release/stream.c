@@ -0,0 +1,127 @@
+/* Out-of-core streaming of complex and motion, see stream.h */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "defs.h"
+#include "image.h"
+#include "stream.h"
+#include "simd.h"
+#include "isa.h"
+#include "conv.h"
+
+/* motion is the 3x3 box filter (see conv.h) */
+static const int motion_box[3 * 3] = {
+  1, 1, 1,
+  1, 1, 1,
+  1, 1, 1
+};
+
+/*
+ * complex_block - complex of in rows [i0, i1) and columns [j0, j1)
+ * into out. in holds rows from in_row on and out rows from out_row on,
+ * of an in_rows x in_cols image.
+ */
+static void complex_block(pixel *in, int in_row, pixel *out, int out_row,
+                          int in_rows, int in_cols,
+                          int i0, int i1, int j0, int j1)
+{
+  int i, j, gray;
+  pixel *s, *d;
+
+  for (i = i0; i < i1; i++) {
+    s = &in[(long)(i - in_row) * in_cols + j0];
+    for (j = j0; j < j1; j++, s++) {
+      d = &out[(long)(in_cols - 1 - j - out_row) * in_rows + (in_rows - 1 - i)];
+      gray = ((int)s->red + (int)s->green + (int)s->blue) / 3;
+      d->red = gray;
+      d->green = gray;
+      d->blue = gray;
+    }
+  }
+}
+
+/* complex_block with SSE4.1 8x8 tiles, as in simd_complex */
+__attribute__((target("sse4.1")))
+static void complex_block_sse(pixel *in, int in_row, pixel *out, int out_row,
+                              int in_rows, int in_cols,
+                              int i0, int i1, int j0, int j1)
+{
+  int i, j, k;
+  int iend = i0 + ((i1 - i0) & ~7);
+  int jend = j0 + ((j1 - j0) & ~7);
+  __m128i row[8];
+
+  for (i = i0; i < iend; i += 8)
+    for (j = j0; j < jend; j += 8) {
+      for (k = 0; k < 8; k++)
+        row[k] = sse_gray8(&in[(long)(i + k - in_row) * in_cols + j]);
+      sse_transpose8(row);
+
+      // Column k of the tile becomes out row in_cols - j - k - 1
+      for (k = 0; k < 8; k++)
+        sse_store8(&out[(long)(in_cols - 1 - j - k - out_row) * in_rows +
+                        (in_rows - i - 8)], row[k]);
+    }
+
+  complex_block(in, in_row, out, out_row, in_rows, in_cols, i0, iend, jend, j1);
+  complex_block(in, in_row, out, out_row, in_rows, in_cols, iend, i1, j0, j1);
+}
+
+void stream_complex(image_file *in, image_file *out, int band)
+{
+  int r0, r1, c0, c1, rows = in->rows, cols = in->cols;
+  int sse = isa_current() >= ISA_SSE41;
+  image_band inb, outb;
+  pixel *ip, *op;
+
+  if (out->rows != cols || out->cols != rows) {
+    fprintf(stderr, "stream_complex: output must be %d x %d\n", cols, rows);
+    exit(1);
+  }
+  if (rows == 0 || cols == 0)
+    return;
+
+  for (r0 = 0; r0 < rows; r0 = r1) {
+    r1 = (r0 + band < rows) ? r0 + band : rows;
+    ip = image_map(in, r0, r1, &inb);
+
+    // in columns [c0, c1) land in out rows [cols - c1, cols - c0)
+    for (c0 = 0; c0 < cols; c0 = c1) {
+      c1 = (c0 + band < cols) ? c0 + band : cols;
+      op = image_map(out, cols - c1, cols - c0, &outb);
+      if (sse)
+        complex_block_sse(ip, r0, op, cols - c1, rows, cols, r0, r1, c0, c1);
+      else
+        complex_block(ip, r0, op, cols - c1, rows, cols, r0, r1, c0, c1);
+      image_unmap(&outb);
+    }
+
+    image_unmap(&inb);
+  }
+}
+
+void stream_motion(image_file *in, image_file *out, int band)
+{
+  int r0, r1, end, rows = in->rows, cols = in->cols;
+  image_band inb, outb;
+  pixel *ip, *op;
+
+  if (out->rows != rows || out->cols != cols) {
+    fprintf(stderr, "stream_motion: output must be %d x %d\n", rows, cols);
+    exit(1);
+  }
+  if (rows == 0 || cols == 0)
+    return;
+
+  for (r0 = 0; r0 < rows; r0 = r1) {
+    r1 = (r0 + band < rows) ? r0 + band : rows;
+    end = (r1 + 2 < rows) ? r1 + 2 : rows;
+
+    // Above the last band the halo rows make every window full height
+    ip = image_map(in, r0, end, &inb);
+    op = image_map(out, r0, r1, &outb);
+    conv_rect_rows(end - r0, cols, ip, op, 0, r1 - r0, 3, motion_box);
+    image_unmap(&outb);
+    image_unmap(&inb);
+  }
+}
@@ -0,0 +1,30 @@
+/*
+ * stream.h - Out-of-core streaming of complex and motion for the
+ * Performance Lab.
+ *
+ * Images live in interleaved image files (see image.h) and can be
+ * any rows x cols size, far beyond MAX_DIM. They are never loaded
+ * whole: the streaming kernels mmap one band of rows at a time, so the
+ * memory they use is set by the band height, not by the image size.
+ */
+#ifndef _STREAM_H_
+#define _STREAM_H_
+
+#include "image.h"
+
+/*
+ * stream_complex - out = complex(in), for an in->rows x in->cols in
+ * and an in->cols x in->rows out. in is read band rows at a time; each
+ * band is written as band x band blocks, each of which lands in band
+ * rows of out. Memory use is about band * (rows + cols) pixels.
+ */
+void stream_complex(image_file *in, image_file *out, int band);
+
+/*
+ * stream_motion - out = motion(in), both in->rows x in->cols. Each
+ * band of output rows maps the same input rows plus a 2 row halo
+ * below them. Memory use is about 2 * (band + 2) * cols pixels.
+ */
+void stream_motion(image_file *in, image_file *out, int band);
+
+#endif /* _STREAM_H_ */
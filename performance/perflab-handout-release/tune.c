@@ -0,0 +1,158 @@
+/* Per host tuning table, see tune.h */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tune.h"
+
+/* What the tuned kernels do on a host that hasn't been tuned: the
+   serial cache-oblivious complex and serial rolling sums motion */
+static const complex_tune complex_default = { 0, 0, 1 };
+static const motion_tune motion_default = { 0, 16, 1, 1, 1 };
+
+static complex_tune complex_table[TUNE_MAX];
+static motion_tune motion_table[TUNE_MAX];
+static int complex_count = 0;
+static int motion_count = 0;
+
+/* How far apart two dimensions are, as a ratio >= 1 */
+static double dim_distance(int a, int b)
+{
+  if (a <= 0 || b <= 0)
+    return 1e30;
+  return (a > b) ? (double)a / b : (double)b / a;
+}
+
+complex_tune tune_complex(int dim)
+{
+  complex_tune t = complex_default;
+  int i;
+
+  for (i = 0; i < complex_count; i++)
+    if (dim_distance(dim, complex_table[i].dim) < dim_distance(dim, t.dim))
+      t = complex_table[i];
+  return t;
+}
+
+motion_tune tune_motion(int dim)
+{
+  motion_tune t = motion_default;
+  int i;
+
+  for (i = 0; i < motion_count; i++)
+    if (dim_distance(dim, motion_table[i].dim) < dim_distance(dim, t.dim))
+      t = motion_table[i];
+  return t;
+}
+
+void tune_set_complex(complex_tune t)
+{
+  int i;
+
+  for (i = 0; i < complex_count; i++)
+    if (complex_table[i].dim == t.dim)
+      break;
+  if (i == TUNE_MAX) {
+    fprintf(stderr, "tune: too many complex entries, dropping dim %d\n", t.dim);
+    return;
+  }
+  complex_table[i] = t;
+  if (i == complex_count)
+    complex_count++;
+}
+
+void tune_set_motion(motion_tune t)
+{
+  int i;
+
+  for (i = 0; i < motion_count; i++)
+    if (motion_table[i].dim == t.dim)
+      break;
+  if (i == TUNE_MAX) {
+    fprintf(stderr, "tune: too many motion entries, dropping dim %d\n", t.dim);
+    return;
+  }
+  motion_table[i] = t;
+  if (i == motion_count)
+    motion_count++;
+}
+
+void tune_clear(void)
+{
+  complex_count = 0;
+  motion_count = 0;
+}
+
+char *tune_path(void)
+{
+  char *path = getenv("PERFLAB_TUNE");
+
+  return (path != NULL && *path != '\0') ? path : TUNE_FILE;
+}
+
+/*
+ * tune_load - Lines look like
+ *     complex <dim> <tile> <threads>
+ *     motion <dim> <band> <threads> <rolling> <unroll>
+ * where <unroll> may be left out and is then 1. Blank lines and lines
+ * starting with '#' are skipped, and so is any line that doesn't parse
+ * or has out of range values.
+ */
+int tune_load(char *path)
+{
+  FILE *fp;
+  char line[256];
+  int n = 0, lineno = 0;
+  complex_tune c;
+  motion_tune m;
+
+  if ((fp = fopen(path, "r")) == NULL)
+    return -1;
+
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    lineno++;
+    if (line[0] == '#' || line[0] == '\n')
+      continue;
+    m.unroll = 1;
+
+    if (sscanf(line, "complex %d %d %d", &c.dim, &c.tile, &c.threads) == 3 &&
+        c.dim > 0 && c.tile >= 0 && c.tile % 8 == 0 && c.threads >= 0) {
+      tune_set_complex(c);
+      n++;
+    }
+    else if (sscanf(line, "motion %d %d %d %d %d", &m.dim, &m.band,
+                    &m.threads, &m.rolling, &m.unroll) >= 4 &&
+             m.dim > 0 && m.band > 0 && m.threads >= 0 &&
+             (m.rolling == 0 || m.rolling == 1) &&
+             (m.unroll == 1 || m.unroll == 2 || m.unroll == 4 || m.unroll == 8)) {
+      tune_set_motion(m);
+      n++;
+    }
+    else
+      fprintf(stderr, "%s:%d: bad tuning entry ignored\n", path, lineno);
+  }
+
+  fclose(fp);
+  return n;
+}
+
+int tune_save(char *path)
+{
+  FILE *fp;
+  int i;
+
+  if ((fp = fopen(path, "w")) == NULL)
+    return -1;
+
+  fprintf(fp, "# Performance Lab tuning file, written by driver -T\n");
+  fprintf(fp, "# complex <dim> <tile> <threads>   (tile 0 = cache-oblivious)\n");
+  fprintf(fp, "# motion <dim> <band> <threads> <rolling> <unroll>\n");
+  for (i = 0; i < complex_count; i++)
+    fprintf(fp, "complex %d %d %d\n", complex_table[i].dim,
+            complex_table[i].tile, complex_table[i].threads);
+  for (i = 0; i < motion_count; i++)
+    fprintf(fp, "motion %d %d %d %d %d\n", motion_table[i].dim,
+            motion_table[i].band, motion_table[i].threads,
+            motion_table[i].rolling, motion_table[i].unroll);
+
+  return fclose(fp) == 0 ? 0 : -1;
+}
@@ -0,0 +1,61 @@
+/*
+ * tune.h - Per host tuning table for the Performance Lab kernels.
+ *
+ * The tuned kernels in kernels.c take their tile size, band height,
+ * thread count, motion loop structure and unroll factor from this
+ * table instead of
+ * compile time constants. "driver -T <file>" measures the candidates
+ * for every test dimension and writes the winners to a tuning file,
+ * which kernels.c loads at startup.
+ */
+#ifndef _TUNE_H_
+#define _TUNE_H_
+
+#include "defs.h"
+
+/* Tuning file read at startup, unless PERFLAB_TUNE names another one */
+#define TUNE_FILE "perflab.tune"
+
+/* Most entries kept per kernel */
+#define TUNE_MAX 32
+
+typedef struct {
+  int dim;
+  int tile;     /* tile edge, a multiple of 8; 0 = cache-oblivious engine */
+  int threads;  /* pool threads, 0 = pool default */
+} complex_tune;
+
+typedef struct {
+  int dim;
+  int band;     /* output rows per pool task */
+  int threads;  /* pool threads, 0 = pool default */
+  int rolling;  /* 1 = rolling column sums, 0 = window helpers */
+  int unroll;   /* window helpers only: output rows per pass, 1, 2, 4 or 8 */
+} motion_tune;
+
+/* Settings for a dim x dim image: the entry whose dim is closest,
+   or the built in defaults when the table is empty */
+complex_tune tune_complex(int dim);
+motion_tune tune_motion(int dim);
+
+/* Add an entry, replacing any entry for the same dim */
+void tune_set_complex(complex_tune t);
+void tune_set_motion(motion_tune t);
+
+/* Forget every entry */
+void tune_clear(void);
+
+/* Name of the tuning file: $PERFLAB_TUNE or TUNE_FILE */
+char *tune_path(void);
+
+/* Read entries from / write all entries to a tuning file. tune_load
+   returns the number of entries read, -1 if the file can't be opened;
+   tune_save returns 0 on success, -1 on error. */
+int tune_load(char *path);
+int tune_save(char *path);
+
+/* The kernels that follow the table, in kernels.c */
+void tuned_complex(int dim, pixel *src, pixel *dest);
+void tuned_motion(int dim, pixel *src, pixel *dst);
+
+#endif /* _TUNE_H_ */
@@ -21,12 +21,25 @@
 #include <unistd.h>
 #include "instruction.h"
 
+/*
+ * A pre-decoded instruction for the threaded interpreter: the address of
+ * the code that executes it, its registers, and its immediate sign-extended
+ * to 32 bits. For jumps and calls the immediate is the index of the target
+ * instruction instead of a byte offset.
+ */
+typedef struct
+{
+  void* handler;
+  int immediate;
+  unsigned char first_register;
+  unsigned char second_register;
+} decoded_t;
+
 // Forward declarations for helper functions
 unsigned int get_file_size(int file_descriptor);
 unsigned int* load_file(int file_descriptor, unsigned int size);
-instruction_t* decode_instructions(unsigned int* bytes, unsigned int num_instructions);
-unsigned int execute_instruction(unsigned int program_counter, instruction_t* instructions, 
-				 int* registers, unsigned char* memory);
+decoded_t* decode_instructions(unsigned int* bytes, unsigned int num_instructions);
+void execute_program(decoded_t* program, unsigned int num_instructions);
 void print_instructions(instruction_t* instructions, unsigned int num_instructions);
 void error_exit(const char* message);
 
@@ -36,6 +49,13 @@ void error_exit(const char* message);
 #define STACK_SIZE 1024
 // Most-Significant Bit
 #define MSB 0x80000000
+// Opcodes are 5 bits
+#define NUM_OPCODES 32
+
+// Handler address of each opcode, then of the end of the program,
+// filled in by execute_program(NULL, 0)
+#define HALT NUM_OPCODES
+static void* handlers[NUM_OPCODES + 1];
 
 int main(int argc, char** argv)
 {
@@ -68,193 +88,210 @@ int main(int argc, char** argv)
   /**** Begin code to modify/implement ****/
   /****************************************/
 
-  // Allocate and decode instructions (left for you to fill in)
-  instruction_t* instructions = decode_instructions(instruction_bytes, num_instructions);
-
-  // Optionally print the decoded instructions for debugging
-  // Will not work until you implement decode_instructions
-  // Do not call this function in your submitted final version
-  // print_instructions(instructions, num_instructions);
-
-
-  // Once you have completed Part 1 (decoding instructions), uncomment the below block
-
-  // Allocate and initialize registers
-  int* registers = (int*)malloc(sizeof(int) * NUM_REGS);
-  for (int i = 0; i < NUM_REGS; i++)
-    registers[i] = 0;
-
-  // Initialize register values
-  registers[6] = STACK_SIZE;
-
-  // Stack memory is byte-addressed, so it must be a 1-byte type
-  unsigned char* memory = (unsigned char*)malloc(sizeof(char) * STACK_SIZE);
-  for (int i = 0; i < STACK_SIZE; i++)
-    memory[i] = 0;
+  // Decode instructions into threaded code
+  decoded_t* program = decode_instructions(instruction_bytes, num_instructions);
 
   // Run the simulation
-  unsigned int program_counter = 0;
-
-  // program_counter is a byte address, so we must multiply num_instructions by 4 
-  // to get the address past the last instruction
-  while(program_counter != num_instructions * 4)
-  {
-    program_counter = execute_instruction(program_counter, instructions, registers, memory);
-  }
+  execute_program(program, num_instructions);
   
   return 0;
 }
 
 /*
- * Decodes the array of raw instruction bytes into an array of instruction_t
+ * Decodes the array of raw instruction bytes into an array of decoded_t
  * Each raw instruction is encoded as a 4-byte unsigned int
+ * One extra entry past the last instruction ends the program when reached
 */
-instruction_t* decode_instructions(unsigned int* bytes, unsigned int num_instructions)
+decoded_t* decode_instructions(unsigned int* bytes, unsigned int num_instructions)
 {
   // Initialize retval
-  instruction_t* retval = (instruction_t*)malloc(sizeof(instruction_t) * num_instructions);
+  decoded_t* retval = (decoded_t*)malloc(sizeof(decoded_t) * (num_instructions + 1));
+  if (retval == NULL)
+    error_exit("unable to allocate memory for decoded instructions");
+
+  // Look up the handler addresses
+  execute_program(NULL, 0);
 
   // Fill in Fields
   for (int i = 0; i < num_instructions; i++)
   {
-    // 0x1F mask is 31 bits
-    retval[i].opcode = (bytes[i] >> 27) & 0x1F;
+    // 0x1F mask is the low 5 bits
+    unsigned char opcode = (bytes[i] >> 27) & 0x1F;
+    int16_t immediate = bytes[i] & 0x0000FFFF;
+
+    retval[i].handler = handlers[opcode];
     retval[i].first_register = (bytes[i] >> 22) & 0x1F;
     retval[i].second_register = (bytes[i] >> 17) & 0x1F;
-    retval[i].immediate = bytes[i] & 0x0000FFFF;
+    retval[i].immediate = immediate;
+
+    // Jumps and calls go to program_counter + 4 + immediate
+    if ((opcode >= je && opcode <= jmp) || opcode == call)
+    {
+      long target = i + 1 + immediate / 4;
+      if (immediate % 4 != 0 || target < 0 || target > num_instructions)
+        error_exit("branch target out of range");
+      retval[i].immediate = target;
+    }
   }
+  retval[num_instructions].handler = handlers[HALT];
     
   return retval;
 }
 
 
 /*
- * Executes a single instruction and returns the next program counter
+ * Executes the program with direct-threaded code: every handler ends by
+ * jumping straight to the handler of the next instruction (computed goto),
+ * and the instruction pointer and register file stay local to this call.
+ * Called with a NULL program, fills in the handler table instead.
 */
-unsigned int execute_instruction(unsigned int program_counter, instruction_t* instructions, int* registers, unsigned char* memory)
+void execute_program(decoded_t* program, unsigned int num_instructions)
 {
-  // program_counter is a byte address, but instructions are 4 bytes each
-  // divide by 4 to get the index into the instructions array
-  instruction_t instr = instructions[program_counter / 4];
-
-  // Registers for comparisons
-  long sreg1 = (long)registers[instr.first_register];
-  long sreg2 = (long)registers[instr.second_register];
-  unsigned long ureg1 = (unsigned long)registers[instr.first_register];
-  unsigned long ureg2 = (unsigned long)registers[instr.second_register];
-
-  // Comparison Vars
-  long signedComp = sreg2 - sreg1;
-  unsigned long unsignedComp = ureg2 - ureg1;
-
-  // Sign-Extension Var
-  unsigned int signEx = 0;
-  
-  switch(instr.opcode)
+  static void* labels[] = {
+    &&do_subl, &&do_addl_reg_reg, &&do_addl_imm_reg, &&do_imull, &&do_shrl,
+    &&do_movl_reg_reg, &&do_movl_deref_reg, &&do_movl_reg_deref, &&do_movl_imm_reg,
+    &&do_cmpl, &&do_je, &&do_jl, &&do_jle, &&do_jge, &&do_jbe, &&do_jmp,
+    &&do_call, &&do_ret, &&do_pushl, &&do_popl, &&do_printr, &&do_readr,
+    &&do_nothing, &&do_halt
+  };
+
+  if (program == NULL)
   {
-  case subl: // 0
-    registers[instr.first_register] = registers[instr.first_register] - instr.immediate;
-    break;
-  case addl_reg_reg: // 1
-    registers[instr.second_register] = registers[instr.first_register] + registers[instr.second_register];
-    break;
-  case addl_imm_reg: // 2
-    registers[instr.first_register] = registers[instr.first_register] + instr.immediate;
-    break;
-  case imull: // 3
-    registers[instr.second_register] = registers[instr.first_register] * registers[instr.second_register];
-    break;
-  case shrl: // 4
-    registers[instr.first_register] = (unsigned int)registers[instr.first_register] >> 1;
-    break;
-  case movl_reg_reg: // 5
-    registers[instr.second_register] = registers[instr.first_register];
-    break;
-  case movl_deref_reg: // 6
-    registers[instr.second_register] = *((int*)(&memory[registers[instr.first_register] + instr.immediate]));
-    break;
-  case movl_reg_deref: // 7
-    *((int*)(&memory[registers[instr.second_register] + instr.immediate])) = registers[instr.first_register];
-    break;
-  case movl_imm_reg: // 8
-    if (instr.immediate < 0)
-      signEx = 0xFFFF0000 | instr.immediate;
-    else
-      signEx = 0x00000000 | instr.immediate;
-
-    registers[instr.first_register] = signEx;
-    break;
-  case cmpl: // 9
-    registers[16] = 0;
-    if (ureg2 < ureg1) // Check for unsigned overflow
-      registers[16] |= 0x1; // Set CF bit on for eflags
-
-    if (signedComp == 0)
-      registers[16] |= 0x40; // Set ZF bit on for eflags
-
-    if (unsignedComp & MSB) // Check if Most-Significant Bit is 1
-      registers[16] |= 0x80; // Set SF bit on for eflags
-
-    if (signedComp > INT32_MAX || signedComp < INT32_MIN) // Check signed overflow
-      registers[16] |= 0x800; // Set OF bit on for eflags
-
-    break;
-  case je: // 10
-    if (registers[16] & 0x00000040) // ZF
-      return program_counter + 4 + instr.immediate;
-    break;
-  case jl: // 11
-    if ((registers[16] & 0x00000080) ^ (registers[16] & 0x00000800)) // SF xor OF
-      return program_counter + 4 + instr.immediate;
-    break;
-  case jle: // 12
-    if ((registers[16] & 0x00000080) ^ (registers[16] & 0x00000800) || registers[16] & 0x00000040) // (SF xor OF) or ZF
-      return program_counter + 4 + instr.immediate;
-    break;
-  case jge: // 13
-    if (!((registers[16] & 0x00000080) ^ (registers[16] & 0x00000800))) // !(SF xor ZF)
-      return program_counter + 4 + instr.immediate;
-    break;
-  case jbe: // 14
-    if ((registers[16] & 0x00000001) || (registers[16] & 0x00000040)) // CF or ZF
-      return program_counter + 4 + instr.immediate;
-    break;
-  case jmp: // 15
-    return program_counter + 4 + instr.immediate;
-    break;
-  case call: // 16
-    registers[6] -= 4;
-    *((int*)(&memory[registers[6]])) = program_counter + 4;
-    return program_counter + 4 + instr.immediate;
-    break;
-  case ret: // 17
-    if (registers[6] == 1024) {
-      exit(0);
-    }
-    else {
-      program_counter = *((int*)(&memory[registers[6]]));
-      registers[6] += 4;
-      return program_counter;
-    }
-    break;
-  case pushl: // 18
-    registers[6] -= 4;
-    *((int*)(&memory[registers[6]])) = registers[instr.first_register];
-    break;
-  case popl: // 19
-    registers[instr.first_register] = *((int*)(&memory[registers[6]]));
-    registers[6] += 4;
-    break;
-  case printr: // 20
-    printf("%d (0x%x)\n", registers[instr.first_register], registers[instr.first_register]);
-    break;
-  case readr: // 21
-    scanf("%d", &(registers[instr.first_register]));
-    break;
+    // Unused opcodes do nothing
+    for (int i = 0; i < NUM_OPCODES; i++)
+      handlers[i] = labels[(i <= readr) ? i : readr + 1];
+    handlers[HALT] = labels[readr + 2];
+    return;
   }
 
-  // program_counter + 4 represents the subsequent instruction
-  return program_counter + 4;
+  int registers[NUM_REGS] = {0};
+  // Stack memory is byte-addressed, so it must be a 1-byte type
+  unsigned char memory[STACK_SIZE] = {0};
+  decoded_t* ip = program;
+  unsigned int address;
+
+  // Initialize register values
+  registers[6] = STACK_SIZE;
+
+  // r1/r2 are the instruction's registers; NEXT goes on to the following
+  // instruction and JUMP to the target index held in the immediate
+#define r1 registers[ip->first_register]
+#define r2 registers[ip->second_register]
+#define DISPATCH() goto *ip->handler
+#define NEXT() do { ip++; DISPATCH(); } while (0)
+#define JUMP() do { ip = program + ip->immediate; DISPATCH(); } while (0)
+
+  DISPATCH();
+
+ do_subl: // 0
+  r1 = r1 - ip->immediate;
+  NEXT();
+ do_addl_reg_reg: // 1
+  r2 = r1 + r2;
+  NEXT();
+ do_addl_imm_reg: // 2
+  r1 = r1 + ip->immediate;
+  NEXT();
+ do_imull: // 3
+  r2 = r1 * r2;
+  NEXT();
+ do_shrl: // 4
+  r1 = (unsigned int)r1 >> 1;
+  NEXT();
+ do_movl_reg_reg: // 5
+  r2 = r1;
+  NEXT();
+ do_movl_deref_reg: // 6
+  r2 = *((int*)(&memory[r1 + ip->immediate]));
+  NEXT();
+ do_movl_reg_deref: // 7
+  *((int*)(&memory[r2 + ip->immediate])) = r1;
+  NEXT();
+ do_movl_imm_reg: // 8
+  r1 = ip->immediate; // Already sign-extended
+  NEXT();
+ do_cmpl: // 9
+  {
+    // Flags of r2 - r1 in 32 bits
+    unsigned int u1 = r1, u2 = r2, diff = u2 - u1;
+    int eflags = 0;
+
+    if (u2 < u1) // Check for unsigned overflow
+      eflags |= 0x1; // Set CF bit on for eflags
+
+    if (diff == 0)
+      eflags |= 0x40; // Set ZF bit on for eflags
+
+    if (diff & MSB) // Check if Most-Significant Bit is 1
+      eflags |= 0x80; // Set SF bit on for eflags
+
+    if ((u1 ^ u2) & (u2 ^ diff) & MSB) // Check signed overflow
+      eflags |= 0x800; // Set OF bit on for eflags
+
+    registers[16] = eflags;
+  }
+  NEXT();
+ do_je: // 10
+  if (registers[16] & 0x00000040) // ZF
+    JUMP();
+  NEXT();
+ do_jl: // 11
+  if ((registers[16] & 0x00000080) ^ (registers[16] & 0x00000800)) // SF xor OF
+    JUMP();
+  NEXT();
+ do_jle: // 12
+  if ((registers[16] & 0x00000080) ^ (registers[16] & 0x00000800) || registers[16] & 0x00000040) // (SF xor OF) or ZF
+    JUMP();
+  NEXT();
+ do_jge: // 13
+  if (!((registers[16] & 0x00000080) ^ (registers[16] & 0x00000800))) // !(SF xor OF)
+    JUMP();
+  NEXT();
+ do_jbe: // 14
+  if ((registers[16] & 0x00000001) || (registers[16] & 0x00000040)) // CF or ZF
+    JUMP();
+  NEXT();
+ do_jmp: // 15
+  JUMP();
+ do_call: // 16
+  // Push the byte address of the next instruction
+  registers[6] -= 4;
+  *((int*)(&memory[registers[6]])) = (ip - program + 1) * 4;
+  JUMP();
+ do_ret: // 17
+  if (registers[6] == STACK_SIZE)
+    exit(0);
+  address = *((int*)(&memory[registers[6]]));
+  registers[6] += 4;
+  if (address % 4 != 0 || address > num_instructions * 4)
+    error_exit("return address misaligned or out of range");
+  ip = program + address / 4;
+  DISPATCH();
+ do_pushl: // 18
+  registers[6] -= 4;
+  *((int*)(&memory[registers[6]])) = r1;
+  NEXT();
+ do_popl: // 19
+  r1 = *((int*)(&memory[registers[6]]));
+  registers[6] += 4;
+  NEXT();
+ do_printr: // 20
+  printf("%d (0x%x)\n", r1, r1);
+  NEXT();
+ do_readr: // 21
+  scanf("%d", &r1);
+  NEXT();
+ do_nothing:
+  NEXT();
+ do_halt:
+  // Reached the address past the last instruction
+  return;
+
+#undef r1
+#undef r2
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
 }
 
 